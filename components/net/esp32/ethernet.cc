@@ -17,7 +17,6 @@
 #include "net/ipnet.h"
 #include <net/ethernet_setup.hh>
 #include "stdint.h"
-#include "main_loop/main_queue.hh"
 #include "debug/log.h"
 
 #ifdef CONFIG_NETWORK_DEBUG
@@ -94,10 +93,7 @@ static void got_ip_event_handler(void *arg, esp_event_base_t event_base, int32_t
   ip4_gateway_address = ip_info->gw;
   ip4_netmask = ip_info->netmask;
 
-  if (ipnet_gotIpAddr_cb)
-    ipnet_gotIpAddr_cb();
-
-  mainLoop_callFun(ipnet_connected);
+  ipnet_event_post(IPNET_EVENT_GOT_IP);
 }
 
 static void ethernet_switch_phy_power(bool on = false) {
@@ -3,6 +3,7 @@
 #include "net/ipnet.h"
 #include "stdint.h"
 #include "esp_netif_ip_addr.h"
+#include "esp_timer.h"
 
 extern esp_ip4_addr_t ip4_address, ip4_gateway_address, ip4_netmask;
 
@@ -25,3 +26,20 @@ void ipnet_cbRegister_gotIpAddr(ipnet_cb cb) {
 void ipnet_cbRegister_lostIpAddr(ipnet_cb cb){
   ipnet_lostIpAddr_cb = cb;
 }
+
+static void (*call_later_fun)(void);
+static void call_later_cb(void *arg) {
+  call_later_fun();
+}
+
+bool ipnet_call_later(void (*fun)(void), unsigned delay_ms) {
+  static esp_timer_handle_t timer;
+  if (!timer) {
+    const esp_timer_create_args_t args = { .callback = call_later_cb, .name = "ipnet_later" };
+    if (esp_timer_create(&args, &timer) != ESP_OK)
+      return false;
+  }
+  esp_timer_stop(timer);
+  call_later_fun = fun;
+  return esp_timer_start_once(timer, delay_ms * 1000ULL) == ESP_OK;
+}
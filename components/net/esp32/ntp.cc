@@ -12,6 +12,7 @@
 
 #ifdef CONFIG_APP_USE_NTP
 #include "net/ntp_client_setup.hh"
+#include "net/ipnet.h"
 #include "esp_event.h"
 #include "esp_event.h"
 #include "esp_system.h"
@@ -103,12 +104,29 @@ static void set_server_by_config(struct cfg_ntp *cfg_ntp) {
 }
 
 
-void ntp_setup(struct cfg_ntp *cfg_ntp) {
+static struct cfg_ntp Ntp_cfg;
+
+static void ntp_start() {
   esp_sntp_stop();
   esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
-  set_server_by_config(cfg_ntp);
+  set_server_by_config(&Ntp_cfg);
   esp_sntp_init();
 }
 
+/// \brief restart on a new IP connection. The "gateway" server may have changed and a sync is due anyway
+static void ntp_ipnet_event(unsigned events, void *arg) {
+  if (events & IPNET_EVENT_GOT_IP)
+    ntp_start();
+}
+
+void ntp_setup(struct cfg_ntp *cfg_ntp) {
+  static bool subscribed;
+  if (!subscribed)
+    subscribed = ipnet_event_subscribe(IPNET_EVENT_GOT_IP, ntp_ipnet_event, nullptr);
+
+  Ntp_cfg = *cfg_ntp;
+  ntp_start();
+}
+
 #endif
 
@@ -1,5 +1,6 @@
 #include "net/tcp_cli_server_setup.hh"
 #include "net/tcp_cli_server.h"
+#include "net/ipnet.h"
 
 #include "cli/cli.h"
 #include "cli/mutex.hh"
@@ -407,25 +408,45 @@ static void callback_unsubscribe() {
   uoCb_unsubscribe(pctChange_cb);
 }
 
-void tcpCli_setup_task(const struct cfg_tcps *cfg_tcps) {
+static struct cfg_tcps Tcps_cfg;
+
+static void tcps_start() {
   static uint8_t ucParameterToPass;
 
-  if (cfg_tcps)
-    UserFlags = cfg_tcps->flags;
+  tcp_cli_server = new TcpCliServer(Tcps_cfg.tcp_port, Tcps_cfg.tcp_port_ia);
+  xTaskCreate(tcps_task, "tcp_server", STACK_SIZE, &ucParameterToPass, tskIDLE_PRIORITY, &xHandle);
+  configASSERT( xHandle );
+}
 
-  if (!cfg_tcps || !cfg_tcps->enable) {
-    if (xHandle) {
-      vTaskDelete(xHandle);
-      xHandle = NULL;
-      delete (tcp_cli_server);
-      tcp_cli_server = 0;
-    }
-    return;
+static void tcps_stop() {
+  if (xHandle) {
+    vTaskDelete(xHandle);
+    xHandle = NULL;
+    delete (tcp_cli_server);
+    tcp_cli_server = 0;
   }
+}
 
-  tcp_cli_server = new TcpCliServer(cfg_tcps->tcp_port, cfg_tcps->tcp_port_ia);
-  xTaskCreate(tcps_task, "tcp_server", STACK_SIZE, &ucParameterToPass, tskIDLE_PRIORITY, &xHandle);
-  configASSERT( xHandle );
+/// \brief start the server when the network comes up, if it is enabled but not running yet
+static void tcps_ipnet_event(unsigned events, void *arg) {
+  if ((events & IPNET_EVENT_GOT_IP) && Tcps_cfg.enable && !xHandle)
+    tcps_start();
+}
+
+void tcpCli_setup_task(const struct cfg_tcps *cfg_tcps) {
+  static bool subscribed;
+  if (!subscribed)
+    subscribed = ipnet_event_subscribe(IPNET_EVENT_GOT_IP, tcps_ipnet_event, nullptr);
+
+  if (cfg_tcps) {
+    UserFlags = cfg_tcps->flags;
+    Tcps_cfg = *cfg_tcps;
+  } else {
+    Tcps_cfg.enable = false;
+  }
 
+  tcps_stop(); // a running server keeps its ports, so restart it with the new configuration
+  if (Tcps_cfg.enable && ipnet_isConnected())
+    tcps_start();
 }
 
@@ -14,7 +14,6 @@
 
 #include "net/ipnet.h"
 #include "stdint.h"
-#include "main_loop/main_queue.hh"
 
 #define printf con_printf_fun
 #ifndef DISTRIBUTION
@@ -24,7 +23,6 @@
 #endif
 
 extern esp_ip4_addr_t ip4_address, ip4_gateway_address, ip4_netmask;
-extern ipnet_cb ipnet_gotIpAddr_cb, ipnet_lostIpAddr_cb;
 
 static void user_set_station_config(struct cfg_wlan *cwl) {
 
@@ -73,10 +71,7 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
 }
 
 static void lost_ip_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
-  if (ipnet_lostIpAddr_cb)
-    ipnet_lostIpAddr_cb();
-
-  mainLoop_callFun(ipnet_disconnected);
+  ipnet_event_post(IPNET_EVENT_LOST_IP);
 }
 
 static void got_ip_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
@@ -88,10 +83,7 @@ static void got_ip_event_handler(void *arg, esp_event_base_t event_base, int32_t
   ip4_gateway_address = ip_info->gw;
   ip4_netmask = ip_info->netmask;
 
-  if (ipnet_gotIpAddr_cb)
-    ipnet_gotIpAddr_cb();
-
-  mainLoop_callFun(ipnet_connected);
+  ipnet_event_post(IPNET_EVENT_GOT_IP);
 }
 void wifistation_setup(struct cfg_wlan *config) {
   if (our_wifi)
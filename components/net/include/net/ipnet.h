@@ -14,8 +14,15 @@
 // interface implemented by mcu specific code
 void ipnet_addr_as_string(char *buf, unsigned buf_len);
 
+/**
+ * \brief           Call FUN once after DELAY_MS from a timer task. A new call replaces a pending one
+ * \return          false if no timer is available
+ */
+bool ipnet_call_later(void (*fun)(void), unsigned delay_ms);
+
 // interface called by mcu specific code
 
+/// \brief called by \ref ipnet_connected. Kept for applications; components use \ref ipnet_event_subscribe
 extern void (*ipnet_CONNECTED_cb)();
 
 /**
@@ -51,9 +58,53 @@ void ipnet_cbRegister_gotIpAddr(ipnet_cb cb);
 void ipnet_cbRegister_lostIpAddr(ipnet_cb cb);
 
 
-
 extern ipnet_cb ipnet_gotIpAddr_cb, ipnet_lostIpAddr_cb;
 
+/// \brief network events (bit mask) delivered to subscribers of \ref ipnet_event_subscribe
+enum ipnet_event {
+  IPNET_EVENT_GOT_IP = 0x01,  ///< got an IP address (connected)
+  IPNET_EVENT_LOST_IP = 0x02, ///< lost IP address (disconnected)
+};
+
+/**
+ * \brief         Callback of \ref ipnet_event_subscribe
+ * \param events  all subscribed events posted since the last call (e.g. LOST_IP|GOT_IP after a short outage).
+ *                Use \ref ipnet_isConnected for the current state
+ * \param arg     as passed to \ref ipnet_event_subscribe
+ */
+typedef void (*ipnet_event_cb)(unsigned events, void *arg);
+
+/**
+ * \brief         Subscribe to network events
+ *
+ *                Callbacks are called in the main loop, after the connection state was updated.
+ *                Unlike \ref ipnet_cbRegister_gotIpAddr, any number of components (up to
+ *                NET_IPNET_EVENT_SUBSCRIBERS) can subscribe.
+ *
+ * \param events  bit mask of \ref ipnet_event
+ * \param cb      callback
+ * \param arg     passed to CB
+ * \return        false if the subscriber table is full
+ */
+bool ipnet_event_subscribe(unsigned events, ipnet_event_cb cb, void *arg);
+
+/**
+ * \brief      Remove subscription of CB with ARG made by \ref ipnet_event_subscribe
+ * \note       Call it from main-thread to make sure CB is not running or called afterwards
+ */
+void ipnet_event_unsubscribe(ipnet_event_cb cb, void *arg);
+
+/**
+ * \brief         Post network events. Called by mcu specific code
+ *
+ *                Calls the legacy callbacks (\ref ipnet_gotIpAddr_cb, \ref ipnet_lostIpAddr_cb) directly and
+ *                schedules a single delivery to subscribers in the main loop. Does not block, so it can be called
+ *                from event handlers.
+ *
+ * \param events  bit mask of \ref ipnet_event
+ */
+void ipnet_event_post(unsigned events);
+
 #ifdef __cplusplus
   }
 #endif
@@ -7,10 +7,14 @@
 
 
 #include "net/ipnet.h"
-#ifdef CONFIG_APP_USE_HTTP
-#include "net_http_server/http_server_setup.h"
-#endif
+#include "main_loop/main_queue.hh"
 #include "stdint.h"
+#include <atomic>
+
+#ifndef CONFIG_NET_IPNET_EVENT_SUBSCRIBERS
+#define CONFIG_NET_IPNET_EVENT_SUBSCRIBERS 8
+#endif
+#define DELIVERY_RETRY_MS 100 ///< delay before trying again to queue the delivery if the main loop queue was full
 
 extern "C++" void main_setup_ip_dependent(void);
 uint32_t ip4_address, ip4_gateway_address, ip4_netmask;
@@ -32,11 +36,90 @@ if(ipnet_CONNECTED_cb)
 
 void ipnet_disconnected(void) {
   Is_connected = false;
-#ifdef CONFIG_APP_USE_HTTP
-  hts_setup(0);
-#endif
 }
 
 bool ipnet_isConnected(void) {
   return Is_connected;
 }
+
+/// \brief slot of the subscriber table. STATE guards CB, ARG and EVENTS
+struct ipnet_subscriber {
+  enum : uint8_t { FREE, BUSY, ACTIVE };
+  std::atomic<uint8_t> state;
+  unsigned events;
+  ipnet_event_cb cb;
+  void *arg;
+};
+
+static ipnet_subscriber Subscribers[CONFIG_NET_IPNET_EVENT_SUBSCRIBERS];
+static std::atomic<unsigned> Pending_events;
+#define DELIVERY_QUEUED 0x80000000u ///< flag in Pending_events: ipnet_event_deliver() is queued or a retry is scheduled
+static std::atomic<bool> Has_ip;
+
+bool ipnet_event_subscribe(unsigned events, ipnet_event_cb cb, void *arg) {
+  for (auto &s : Subscribers) {
+    uint8_t expected = ipnet_subscriber::FREE;
+    if (!s.state.compare_exchange_strong(expected, ipnet_subscriber::BUSY, std::memory_order_acquire))
+      continue;
+    s.events = events;
+    s.cb = cb;
+    s.arg = arg;
+    s.state.store(ipnet_subscriber::ACTIVE, std::memory_order_release);
+    return true;
+  }
+  return false;
+}
+
+void ipnet_event_unsubscribe(ipnet_event_cb cb, void *arg) {
+  for (auto &s : Subscribers) {
+    uint8_t expected = ipnet_subscriber::ACTIVE;
+    if (!s.state.compare_exchange_strong(expected, ipnet_subscriber::BUSY, std::memory_order_acquire))
+      continue;
+    const bool match = s.cb == cb && s.arg == arg;
+    s.state.store(match ? ipnet_subscriber::FREE : ipnet_subscriber::ACTIVE, std::memory_order_release);
+  }
+}
+
+/// \brief runs in main loop: apply the connection state and notify subscribers of all events posted since last run
+static void ipnet_event_deliver() {
+  const unsigned events = Pending_events.exchange(0, std::memory_order_acquire) & ~DELIVERY_QUEUED;
+
+  if (events & IPNET_EVENT_LOST_IP)
+    ipnet_disconnected();
+  if ((events & IPNET_EVENT_GOT_IP) && Has_ip.load(std::memory_order_relaxed))
+    ipnet_connected();
+
+  for (auto &s : Subscribers) {
+    if (s.state.load(std::memory_order_acquire) != ipnet_subscriber::ACTIVE || !(s.events & events))
+      continue;
+    s.cb(s.events & events, s.arg);
+  }
+}
+
+/// \brief queue ipnet_event_deliver() in the main loop. If its queue is full, try again from a timer
+static void ipnet_event_queue_delivery() {
+  if (mainLoop_callFun(ipnet_event_deliver))
+    return;
+  if (ipnet_call_later(ipnet_event_queue_delivery, DELIVERY_RETRY_MS))
+    return; // events posted meanwhile are coalesced, because DELIVERY_QUEUED stays set
+  // no timer: keep the events pending, so the next post tries again
+  Pending_events.fetch_and(~DELIVERY_QUEUED, std::memory_order_relaxed);
+}
+
+void ipnet_event_post(unsigned events) {
+  if (events & IPNET_EVENT_GOT_IP) {
+    Has_ip.store(true, std::memory_order_relaxed);
+    if (ipnet_gotIpAddr_cb)
+      ipnet_gotIpAddr_cb();
+  }
+  if (events & IPNET_EVENT_LOST_IP) {
+    Has_ip.store(false, std::memory_order_relaxed);
+    if (ipnet_lostIpAddr_cb)
+      ipnet_lostIpAddr_cb();
+  }
+
+  // only the first event posted since the last delivery queues a call. Later ones are coalesced into it
+  if (Pending_events.fetch_or(events | DELIVERY_QUEUED, std::memory_order_release) & DELIVERY_QUEUED)
+    return;
+  ipnet_event_queue_delivery();
+}
@@ -0,0 +1,49 @@
+#include "bench.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+static std::atomic<uint64_t> alloc_count;
+
+void* operator new(size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+uint64_t bench_allocs() {
+  return alloc_count.load(std::memory_order_relaxed);
+}
+
+uint64_t bench_ns_now() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t BenchLatency::percentile(unsigned percent) {
+  if (m_ns.empty())
+    return 0;
+  std::sort(m_ns.begin(), m_ns.end());
+  const size_t rank = (m_ns.size() * percent + 99) / 100;
+  return m_ns[rank ? rank - 1 : 0];
+}
+
+void bench_report(const char *name, uint64_t count, uint64_t elapsed, BenchLatency *latency, uint64_t allocs) {
+  printf("%-24s %8llu ops %10.0f ops/s", name, (unsigned long long) count, elapsed ? count * 1e9 / elapsed : 0.0);
+  if (latency && latency->size())
+    printf("  p50 %9.2f us  p99 %9.2f us", latency->percentile(50) / 1e3, latency->percentile(99) / 1e3);
+  printf("  %.2f allocs/op\n", count ? double(allocs) / count : 0.0);
+}
@@ -0,0 +1,49 @@
+/**
+ * \file   bench.hh
+ * \brief  Helpers shared by the host benchmarks: clock, allocation counter and latency percentiles
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// \brief monotonic time in nanoseconds
+uint64_t bench_ns_now();
+
+/// \brief number of calls of the global operator new since program start (all threads)
+uint64_t bench_allocs();
+
+/**
+ * \brief  Latency samples of a benchmark run
+ *
+ *         Storage is reserved up front, so adding samples does not allocate while measuring.
+ */
+class BenchLatency {
+public:
+  explicit BenchLatency(size_t max_samples) {
+    m_ns.reserve(max_samples);
+  }
+  void add(uint64_t ns) {
+    if (m_ns.size() < m_ns.capacity())
+      m_ns.push_back(ns);
+  }
+  size_t size() const {
+    return m_ns.size();
+  }
+  /// \brief get latency in nanoseconds at PERCENT (0..100). Sorts the samples
+  uint64_t percentile(unsigned percent);
+
+private:
+  std::vector<uint64_t> m_ns;
+};
+
+/**
+ * \brief          Print a result line
+ * \param name     what was measured
+ * \param count    number of operations
+ * \param elapsed  duration of the run in nanoseconds
+ * \param latency  latency samples or nullptr
+ * \param allocs   allocations made during the run
+ */
+void bench_report(const char *name, uint64_t count, uint64_t elapsed, BenchLatency *latency, uint64_t allocs);
@@ -0,0 +1,226 @@
+/**
+ * \file   http_load.cc
+ * \brief  Load test of the host HTTP server: many keep-alive connections sending pipelined requests
+ *
+ *         Usage: http_load [--connections N] [--requests N] [--pipeline N] [--threads N] [--size BYTES]
+ *
+ *         The server is started in this process on NET_HTTP_SERVER_HOST_PORT with a single handler responding
+ *         SIZE bytes. Each client thread owns a share of the connections and sends PIPELINE requests on each of them
+ *         before reading the responses. Latency is measured from sending a batch to receiving each response.
+ *         Exits with 1 if a request failed, so it can be run in CI.
+ */
+#include "bench.hh"
+#include "net_http_server/http_server_setup.h"
+#include "net_http_server/host/http_server_host.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static struct {
+  unsigned connections = 64;
+  unsigned requests = 1000; ///< per connection
+  unsigned pipeline = 1;
+  unsigned threads = 4;
+  unsigned size = 512;
+} opt;
+
+static std::string body;
+static std::atomic<unsigned> failed;
+
+static esp_err_t load_handler(httpd_req_t *req) {
+  httpd_resp_set_type(req, "text/plain");
+  return httpd_resp_send(req, body.data(), body.size());
+}
+
+static void register_handlers(httpd_handle_t server) {
+  static const httpd_uri_t load = { .uri = "/load", .method = HTTP_GET, .handler = load_handler, .user_ctx = nullptr, .is_websocket = false };
+  httpd_register_uri_handler(server, &load);
+}
+
+static int connect_server() {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in sa = { };
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(CONFIG_NET_HTTP_SERVER_HOST_PORT);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 || connect(fd, (struct sockaddr*) &sa, sizeof sa) < 0) {
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+  return fd;
+}
+
+/**
+ * \brief     remove the first complete response from IN
+ * \return    1 for status 200, 0 for another status, -1 if not yet complete
+ */
+static int take_response(std::string &in) {
+  const size_t hdr_end = in.find("\r\n\r\n");
+  if (hdr_end == std::string::npos)
+    return -1;
+  size_t body_len = 0;
+  if (const size_t cl = in.find("Content-Length: "); cl < hdr_end)
+    body_len = strtoul(in.c_str() + cl + 16, nullptr, 10);
+  if (in.size() < hdr_end + 4 + body_len)
+    return -1;
+  const bool ok = in.compare(0, 12, "HTTP/1.1 200") == 0;
+  in.erase(0, hdr_end + 4 + body_len);
+  return ok;
+}
+
+/// \brief send all requests on connections FDS and add the latency of each response to SAMPLES
+static void client_thread(std::vector<int> fds, std::vector<uint64_t> *samples) {
+  std::string batch;
+  for (unsigned i = 0; i < opt.pipeline; ++i)
+    batch += "GET /load HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  std::vector<std::string> in(fds.size());
+  char buf[16384];
+
+  for (unsigned sent = 0; sent < opt.requests; sent += opt.pipeline) {
+    const unsigned n = std::min(opt.pipeline, opt.requests - sent);
+    const size_t batch_len = n * (batch.size() / opt.pipeline);
+    const uint64_t start = bench_ns_now();
+    for (size_t c = 0; c < fds.size(); ++c) {
+      if (fds[c] >= 0 && write(fds[c], batch.data(), batch_len) != ssize_t(batch_len)) {
+        close(fds[c]);
+        fds[c] = -1;
+      }
+    }
+    for (size_t c = 0; c < fds.size(); ++c) {
+      unsigned received = 0;
+      while (fds[c] >= 0 && received < n) {
+        if (int res = take_response(in[c]); res >= 0) {
+          samples->push_back(bench_ns_now() - start);
+          if (!res)
+            ++failed;
+          ++received;
+          continue;
+        }
+        const ssize_t len = read(fds[c], buf, sizeof buf);
+        if (len <= 0) {
+          close(fds[c]);
+          fds[c] = -1;
+          break;
+        }
+        in[c].append(buf, len);
+      }
+      failed += n - received;
+    }
+  }
+  for (int fd : fds) {
+    if (fd >= 0)
+      close(fd);
+  }
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [--connections N] [--requests N] [--pipeline N] [--threads N] [--size BYTES]\n", prog);
+  exit(2);
+}
+
+static void parse_args(int argc, char *argv[]) {
+  static const struct option long_opts[] = { { "connections", required_argument, nullptr, 'c' }, { "requests", required_argument, nullptr, 'n' }, {
+      "pipeline", required_argument, nullptr, 'p' }, { "threads", required_argument, nullptr, 't' }, { "size", required_argument, nullptr, 's' }, { "help",
+      no_argument, nullptr, 'h' }, { } };
+  for (int c; (c = getopt_long(argc, argv, "c:n:p:t:s:h", long_opts, nullptr)) != -1;) {
+    switch (c) {
+    case 'c':
+      opt.connections = strtoul(optarg, nullptr, 0);
+      break;
+    case 'n':
+      opt.requests = strtoul(optarg, nullptr, 0);
+      break;
+    case 'p':
+      opt.pipeline = strtoul(optarg, nullptr, 0);
+      break;
+    case 't':
+      opt.threads = strtoul(optarg, nullptr, 0);
+      break;
+    case 's':
+      opt.size = strtoul(optarg, nullptr, 0);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (!opt.connections || opt.connections > 255 || !opt.requests || !opt.pipeline || !opt.threads)
+    usage(argv[0]); // cfg_http::max_open_sockets is 8 bit
+  opt.threads = std::min(opt.threads, opt.connections);
+}
+
+int main(int argc, char *argv[]) {
+  parse_args(argc, argv);
+  body.assign(opt.size, 'x');
+
+  hts_register_uri_handlers_cb = register_handlers;
+  cfg_http cfg;
+  cfg.user[0] = cfg.password[0] = '\0';
+  cfg.enable = 1;
+  cfg.max_open_sockets = opt.connections;
+  cfg.lru_purge = false; // all connections stay in use
+  hts_setup(&cfg);
+  if (!hts_server) {
+    fprintf(stderr, "http_load: cannot start server on port %d\n", CONFIG_NET_HTTP_SERVER_HOST_PORT);
+    return 1;
+  }
+
+  std::vector<std::vector<int>> fds(opt.threads);
+  for (unsigned c = 0; c < opt.connections; ++c) {
+    const int fd = connect_server();
+    if (fd < 0) {
+      perror("http_load: connect");
+      return 1;
+    }
+    fds[c % opt.threads].push_back(fd);
+  }
+
+  const uint64_t total = uint64_t(opt.connections) * opt.requests;
+  printf("%u connections, %u requests each, pipeline %u, %u threads, %u bytes\n", opt.connections, opt.requests, opt.pipeline, opt.threads, opt.size);
+  std::vector<std::vector<uint64_t>> samples(opt.threads);
+  std::vector<std::thread> threads;
+  const uint64_t allocs_start = bench_allocs();
+  const uint64_t start = bench_ns_now();
+  for (unsigned t = 0; t < opt.threads; ++t) {
+    samples[t].reserve(total / opt.threads + opt.requests);
+    threads.emplace_back(client_thread, fds[t], &samples[t]);
+  }
+  for (auto &t : threads)
+    t.join();
+  const uint64_t elapsed = bench_ns_now() - start;
+  const uint64_t allocs = bench_allocs() - allocs_start;
+
+  BenchLatency latency(total);
+  for (auto &s : samples) {
+    for (uint64_t ns : s)
+      latency.add(ns);
+  }
+  bench_report("requests", total, elapsed, &latency, allocs);
+
+  hts_stats stats;
+  if (hts_get_stats(&stats))
+    printf("accepted %u, closed %u, open peak %u\n", stats.accepted, stats.closed, stats.open_peak);
+  cfg.enable = 0;
+  hts_setup(&cfg);
+
+  if (failed) {
+    fprintf(stderr, "http_load: %u of %llu requests failed\n", failed.load(), (unsigned long long) total);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * \file   uri_bench.cc
+ * \brief  Lookup benchmark of URI routing (UriTrie) and of static content (bundle generated by web_bundle.py)
+ *
+ *         Usage: uri_bench [--count N]
+ *
+ *         Each lookup is compared with matching the registered URIs in turn, like esp_http_server does with
+ *         httpd_uri_match_wildcard. Latencies are measured per lookup and include the overhead of reading the clock.
+ */
+#include "bench.hh"
+#include "net_http_server/content.hh"
+#include "net_http_server/uri_trie.hh"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+/// \brief test if URI matches PATTERN (which may end with '*'). \return length of matched prefix or -1
+static int uri_matches(const char *pattern, const char *uri, size_t uri_len) {
+  const size_t len = strlen(pattern);
+  if (len && pattern[len - 1] == '*')
+    return uri_len >= len - 1 && strncmp(pattern, uri, len - 1) == 0 ? int(len - 1) : -1;
+  return uri_len == len && strncmp(pattern, uri, len) == 0 ? int(len) : -1;
+}
+
+/// \brief find URI by matching each pattern in turn, preferring exact and longer matches like UriTrie
+static int linear_find(const std::vector<std::string> &patterns, const char *uri) {
+  const size_t uri_len = strcspn(uri, "?");
+  int best = -1, best_len = -1;
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    const int len = uri_matches(patterns[i].c_str(), uri, uri_len);
+    if (len < 0)
+      continue;
+    if (size_t(len) == uri_len && patterns[i].back() != '*')
+      return i;
+    if (len > best_len)
+      best = i, best_len = len;
+  }
+  return best;
+}
+
+/// \brief run FN(uri) COUNT times over URIS. \return sum of results of FN
+template<typename Fn>
+static int64_t run(const char *name, unsigned count, const std::vector<std::string> &uris, Fn &&fn) {
+  BenchLatency latency(count);
+  int64_t sum = 0;
+  const uint64_t allocs_start = bench_allocs();
+  const uint64_t start = bench_ns_now();
+  for (unsigned i = 0; i < count; ++i) {
+    const char *uri = uris[i % uris.size()].c_str();
+    const uint64_t t = bench_ns_now();
+    sum += fn(uri);
+    latency.add(bench_ns_now() - t);
+  }
+  const uint64_t elapsed = bench_ns_now() - start;
+  bench_report(name, count, elapsed, &latency, bench_allocs() - allocs_start);
+  return sum;
+}
+
+static bool bench_routes(unsigned count) {
+  std::vector<std::string> patterns = { "/cmd.json", "/config.json", "/status.json", "/stats.json", "/ws", "/sse", "/login", "/logout",
+      "/ota", "/f/*", "/api/v1/*", "/api/v1/dev/*", "/files/*", "/doc/*" };
+  for (unsigned i = 0; i < 20; ++i)
+    patterns.push_back("/dev/" + std::to_string(i) + "/cmd");
+
+  UriTrie<int> trie;
+  for (size_t i = 0; i < patterns.size(); ++i)
+    trie.add(patterns[i].c_str(), i);
+
+  std::vector<std::string> uris = { "/cmd.json", "/status.json?x=1", "/f/js/wapp.js", "/api/v1/dev/7/pct", "/api/v1/version", "/ws",
+      "/dev/13/cmd", "/dev/99/cmd", "/favicon.ico", "/doc/index.html" };
+
+  printf("%zu routes, %zu URIs\n", patterns.size(), uris.size());
+  const int64_t trie_sum = run("UriTrie routes", count, uris, [&trie](const char *uri) {
+    const int *idx = trie.find(uri, strlen(uri));
+    return idx ? *idx : -1;
+  });
+  const int64_t linear_sum = run("linear routes", count, uris, [&patterns](const char *uri) {
+    return linear_find(patterns, uri);
+  });
+  return trie_sum == linear_sum;
+}
+
+static bool bench_bundle(unsigned count) {
+  std::vector<std::string> patterns;
+  UriTrie<const file_map*> trie;
+  for (unsigned i = 0; i < wc_bundled_files_count; ++i) {
+    patterns.push_back(wc_bundled_files[i].uri);
+    trie.add(wc_bundled_files[i].uri, &wc_bundled_files[i]);
+  }
+
+  std::vector<std::string> uris;
+  for (unsigned i = 0; i < wc_bundled_files_count; ++i)
+    uris.push_back(wc_bundled_files[i].uri + std::string(i % 4 == 0 ? "?v=1" : ""));
+  uris.push_back("/missing.js");
+  uris.push_back("/js/missing.js");
+
+  printf("%u bundled files, %zu URIs\n", wc_bundled_files_count, uris.size());
+  const int64_t hash_sum = run("wc_getContent", count, uris, [](const char *uri) {
+    const file_map *fm = wc_getContent(uri);
+    return fm ? int(fm - wc_bundled_files) : -1;
+  });
+  const int64_t trie_sum = run("UriTrie content", count, uris, [&trie](const char *uri) {
+    const file_map *const *fm = trie.find(uri, strlen(uri));
+    return fm ? int(*fm - wc_bundled_files) : -1;
+  });
+  const int64_t linear_sum = run("linear content", count, uris, [&patterns](const char *uri) {
+    return linear_find(patterns, uri);
+  });
+  return hash_sum == trie_sum && hash_sum == linear_sum;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned count = 1000000;
+  static const struct option long_opts[] = { { "count", required_argument, nullptr, 'n' }, { } };
+  for (int c; (c = getopt_long(argc, argv, "n:", long_opts, nullptr)) != -1;) {
+    if (c != 'n') {
+      fprintf(stderr, "usage: %s [--count N]\n", argv[0]);
+      return 2;
+    }
+    count = strtoul(optarg, nullptr, 0);
+  }
+
+  if (!bench_routes(count) || !bench_bundle(count)) {
+    fprintf(stderr, "uri_bench: results differ\n");
+    return 1;
+  }
+  return 0;
+}
@@ -1,15 +1,28 @@
 #include "http_server_impl.h"
+#include "auth_token.hh"
 #include "net_http_server/http_server_setup.h"
 //#include "uout/uout_builder_json.hh"
 #include "net_http_server/esp32/http_server_esp32.h"
+#include "net_http_server/uri_trie.hh"
+#include "net_http_server/req_arena.h"
+#include "net_http_server/req_view.hh"
+#include "req_arena.hh"
 #include "debug/dbg.h"
+#include "net/ipnet.h"
 #include <esp_wifi.h>
 #include <esp_event.h>
 #include <esp_log.h>
 #include <esp_system.h>
+#include <esp_random.h>
+#include <esp_timer.h>
 #include <sys/param.h>
+#include <unistd.h>
+#include <strings.h>
 #include <mbedtls/base64.h>
+#include <mbedtls/sha256.h>
 #include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <utils_misc/cstring_utils.hh>
 
 static const char *TAG="http_server";
@@ -18,20 +31,98 @@ static const char *TAG="http_server";
 
 //////////////////////////Authorization//////////////////////
 #define MAX_LOGIN_LEN 256
+#define AUTH_CACHE_SIZE 8 ///< direct mapped (socket number modulo size)
 
 static csu auth_user, auth_password;
+static bool auth_required;
+static uint32_t auth_token_lifetime;
+static uint8_t auth_digest[32]; ///< SHA-256 of the expected Authorization header value ("Basic base64(user:password)")
 
 #define HTTP_USER (auth_user)
-#define HTTP_USER_LEN (strlen(auth_user))
 #define HTTP_PW (auth_password)
-#define HTTP_PW_LEN  (strlen(auth_password))
 
-static bool verify_userName_and_passWord(const char *up, size_t up_len) {
+#define AUTH_UP_SIZE (sizeof cfg_http::user + sizeof cfg_http::password) ///< buffer size for "user:password"
+#define AUTH_HDR_SIZE (6 + (AUTH_UP_SIZE + 2) / 3 * 4 + 1) ///< buffer size for "Basic base64(user:password)"
 
-  if (HTTP_USER_LEN + 1 + HTTP_PW_LEN != up_len)
+/// \brief remembers the already verified Authorization header of a connection
+struct auth_cache_entry {
+  int sockfd;
+  uint16_t hdr_len;
+  char hdr[AUTH_HDR_SIZE];
+};
+static auth_cache_entry auth_cache[AUTH_CACHE_SIZE];
+
+static bool ct_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; ++i)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+static void auth_cache_clear() {
+  for (auto &ace : auth_cache) {
+    ace.sockfd = -1;
+  }
+}
+
+static void auth_cache_forget(int sockfd) {
+  auto &ace = auth_cache[sockfd % AUTH_CACHE_SIZE];
+  if (ace.sockfd == sockfd)
+    ace.sockfd = -1;
+}
+
+static uint32_t uptime_s() {
+  return esp_timer_get_time() / 1000000;
+}
+
+static void auth_token_setup(uint32_t lifetime) {
+  auth_token_lifetime = lifetime;
+  if (!lifetime)
+    return;
+  uint8_t key[32];
+  esp_fill_random(key, sizeof key);
+  authToken_setKey(key, sizeof key);
+}
+
+/// \brief issue a new session token as cookie with the response to REQ
+static void auth_token_issue(httpd_req_t *req) {
+  char token[AUTH_TOKEN_LEN + 1];
+
+  if (!authToken_create(token, sizeof token, uptime_s() + auth_token_lifetime))
+    return;
+  // request memory stays valid until the response is sent
+  if (auto cookie = hts_req_printf(req, AUTH_TOKEN_COOKIE "=%s; Max-Age=%lu; Path=/; HttpOnly; SameSite=Strict", token, (unsigned long) auth_token_lifetime))
+    httpd_resp_set_hdr(req, "Set-Cookie", cookie);
+}
+
+static bool verify_token_cookie(httpd_req_t *req) {
+  char token[AUTH_TOKEN_LEN + 1];
+  size_t token_size = sizeof token;
+  if (ESP_OK != httpd_req_get_cookie_val(req, AUTH_TOKEN_COOKIE, token, &token_size))
+    return false;
+  return authToken_verify(token, strlen(token), uptime_s());
+}
+
+static bool auth_setup(const char *user, const char *password) {
+  auth_user = user;
+  auth_password = password;
+  auth_required = !(*HTTP_USER == '\0' && *HTTP_PW == '\0');
+  auth_cache_clear();
+
+  if (!auth_required)
+    return true;
+
+  char up[AUTH_UP_SIZE];
+  const int up_len = snprintf(up, sizeof up, "%s:%s", user, password);
+  if (up_len < 0 || up_len >= (int) sizeof up)
+    return false;
+
+  char hdr[AUTH_HDR_SIZE] = "Basic ";
+  size_t olen = 0;
+  if (0 != mbedtls_base64_encode((unsigned char*) hdr + 6, sizeof hdr - 6, &olen, (const unsigned char*) up, up_len))
     return false;
 
-  return strncmp(HTTP_USER, up, HTTP_USER_LEN) == 0 && strncmp(HTTP_PW, up + (up_len - HTTP_PW_LEN), HTTP_PW_LEN) == 0;
+  return 0 == mbedtls_sha256((const unsigned char*) hdr, 6 + olen, auth_digest, 0);
 }
 
 static bool verify_authorization(httpd_req_t *req) {
@@ -44,20 +135,42 @@ static bool verify_authorization(httpd_req_t *req) {
   if (login_len > MAX_LOGIN_LEN)
     return false;
 
-  char login[login_len + 1];
-  esp_err_t err = httpd_req_get_hdr_value_str(req, "Authorization", login, login_len + 1);
-  if (err == ESP_OK) {
-    unsigned char dst[128];
-    size_t olen = 0;
-    if (0 == mbedtls_base64_decode(dst, sizeof dst, &olen, (unsigned char*) login + 6, login_len - 6))
-      return verify_userName_and_passWord((char*) dst, olen);
+  const char *login = hts_req_get_hdr(req, "Authorization");
+  if (!login)
+    return false;
+
+  if (auth_token_lifetime && 0 == strncmp(login, "Bearer ", 7))
+    return authToken_verify(login + 7, login_len - 7, uptime_s());
+
+  // same credentials as in a previous request on this connection
+  const int sockfd = httpd_req_to_sockfd(req);
+  auto &ace = auth_cache[sockfd % AUTH_CACHE_SIZE];
+  if (ace.sockfd == sockfd && ace.hdr_len == login_len && ct_equal((const uint8_t*) ace.hdr, (const uint8_t*) login, login_len))
+    return true;
+
+  uint8_t digest[sizeof auth_digest];
+  if (0 != mbedtls_sha256((const unsigned char*) login, login_len, digest, 0))
+    return false;
+  if (!ct_equal(digest, auth_digest, sizeof digest))
+    return false;
+
+  if (login_len < sizeof ace.hdr) {
+    ace.sockfd = sockfd;
+    ace.hdr_len = login_len;
+    memcpy(ace.hdr, login, login_len);
   }
 
-  return false;
+  if (auth_token_lifetime)
+    auth_token_issue(req);
+  return true;
 }
 
 static bool is_access_allowed(httpd_req_t *req) {
-  return (*HTTP_USER == '\0' && *HTTP_PW == '\0') || verify_authorization(req);
+  if (!auth_required)
+    return true;
+  if (auth_token_lifetime && verify_token_cookie(req))
+    return true;
+  return verify_authorization(req);
 }
 
 static void reqest_authorization(httpd_req_t *req) {
@@ -76,40 +189,256 @@ bool check_access_allowed(httpd_req_t *req) {
   return true;
 }
 
+//////////////////////////Request memory//////////////////////
+char *hts_req_get_hdr(struct httpd_req *req, const char *field) {
+  const size_t len = httpd_req_get_hdr_value_len(req, field);
+  if (!len)
+    return nullptr;
+  auto val = static_cast<char*>(hts_req_alloc(req, len + 1));
+  if (!val || ESP_OK != httpd_req_get_hdr_value_str(req, field, val, len + 1))
+    return nullptr;
+  return val;
+}
+
+char *hts_req_get_query(struct httpd_req *req) {
+  const size_t len = httpd_req_get_url_query_len(req);
+  if (!len)
+    return nullptr;
+  auto query = static_cast<char*>(hts_req_alloc(req, len + 1));
+  if (!query || ESP_OK != httpd_req_get_url_query_str(req, query, len + 1))
+    return nullptr;
+  return query;
+}
+
+ReqView::ReqView(httpd_req_t *req) :
+    m_req(req) {
+  parse(req->uri);
+}
+
+std::string_view ReqView::header(const char *name) const {
+  for (unsigned i = 0; i < m_header_count; ++i) {
+    if (0 == strcasecmp(m_headers[i].name, name))
+      return m_headers[i].value;
+  }
+
+  // esp_http_server keeps its parsed headers private. So copy the value into request memory and remember it.
+  const char *value = hts_req_get_hdr(m_req, name);
+  const std::string_view result = value ? std::string_view(value) : std::string_view();
+  if (m_header_count < HEADERS_CACHED)
+    m_headers[m_header_count++] = { name, result };
+  return result;
+}
+
+//////////////////////////Routing//////////////////////
+#define ROUTE_TABLES_MAX 4 ///< number of different HTTP methods supported by routing
+
+struct route_table {
+  int method = -1;
+  UriTrie<httpd_uri_t> routes;
+};
+static route_table Route_tables[ROUTE_TABLES_MAX];
+static bool Routes_deferred; ///< true while dispatchers are not yet registered
+
+static esp_err_t route_dispatch(httpd_req_t *req) {
+  auto rt = static_cast<const route_table*>(req->user_ctx);
+  esp_err_t res = ESP_OK;
+
+  if (auto route = rt->routes.find(req->uri, strlen(req->uri))) {
+    req->user_ctx = route->user_ctx;
+    res = route->handler(req);
+  } else {
+    res = httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
+  }
+  hts_req_free_all(req); // the response has been sent
+  return res;
+}
+
+static esp_err_t route_register_dispatcher(httpd_handle_t server, route_table &rt) {
+  httpd_uri_t dispatcher = { .uri = "/*", .method = static_cast<httpd_method_t>(rt.method), .handler = route_dispatch, .user_ctx = &rt };
+  return httpd_register_uri_handler(server, &dispatcher);
+}
+
+static void routes_clear() {
+  for (auto &rt : Route_tables) {
+    rt.method = -1;
+    rt.routes.clear();
+  }
+}
+
+esp_err_t hts_register_route(httpd_handle_t server, const httpd_uri_t *uri_handler) {
+  route_table *rt = nullptr;
+  for (auto &it : Route_tables) {
+    if (it.method == uri_handler->method || it.method == -1) {
+      rt = &it;
+      break;
+    }
+  }
+  if (!rt) {
+    ESP_LOGE(TAG, "routing: too many methods");
+    return ESP_ERR_NO_MEM;
+  }
+
+  const bool new_method = rt->method == -1;
+  rt->method = uri_handler->method;
+  if (!rt->routes.add(uri_handler->uri, *uri_handler)) {
+    ESP_LOGE(TAG, "routing: cannot add route <%s>", uri_handler->uri);
+    return ESP_ERR_HTTPD_HANDLER_EXISTS;
+  }
+
+  if (new_method && !Routes_deferred)
+    return route_register_dispatcher(server, *rt);
+  return ESP_OK;
+}
+
+//////////////////////////Request Memory//////////////////////
+// esp_http_server processes one request at a time in its task, so one arena is enough.
+static ReqArena Req_arena(CONFIG_NET_HTTP_SERVER_REQ_ARENA_SIZE);
+static TaskHandle_t Server_task; ///< task of the running server (set by open_fn)
+
+ReqArena& hts_req_arena(struct httpd_req *req) {
+  return Req_arena;
+}
+
+//////////////////////////Connection Accounting//////////////////////
+static struct hts_stats Stats;
+
+static esp_err_t hts_open_fn(httpd_handle_t hd, int sockfd) {
+  Server_task = xTaskGetCurrentTaskHandle();
+  ++Stats.accepted;
+  if (++Stats.open > Stats.open_peak)
+    Stats.open_peak = Stats.open;
+  return ESP_OK;
+}
+
+static void hts_close_fn(httpd_handle_t hd, int sockfd) {
+  ++Stats.closed;
+  if (Stats.open)
+    --Stats.open;
+  auth_cache_forget(sockfd);
+  sse_forget(sockfd);
+  close(sockfd);
+}
+
+static esp_err_t handle_uri_stats(httpd_req_t *req) {
+  if (!check_access_allowed(req)) {
+    hts_req_free_all(req);
+    return ESP_FAIL;
+  }
+
+  hts_file_cache_stats fcs {};
+  hts_get_file_cache_stats(&fcs);
+
+  const char *json = hts_req_printf(req, "{\"http_stats\":{\"open\":%u,\"open_peak\":%u,\"open_max\":%u,\"accepted\":%lu,\"closed\":%lu," //
+      "\"file_cache\":{\"hits\":%lu,\"misses\":%lu,\"evictions\":%lu,\"bytes\":%lu,\"entries\":%u}}}", //
+      Stats.open, Stats.open_peak, Stats.open_max, (unsigned long) Stats.accepted, (unsigned long) Stats.closed, //
+      (unsigned long) fcs.hits, (unsigned long) fcs.misses, (unsigned long) fcs.evictions, (unsigned long) fcs.bytes_used, fcs.entries);
+  httpd_resp_set_type(req, "application/json");
+  const esp_err_t res = json ? httpd_resp_sendstr(req, json) : httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+  hts_req_free_all(req);
+  return res;
+}
+
+/**
+ * \brief  URI matching, called by the server task for each registered handler while looking up the handler of a
+ *         request, and by httpd_register_uri_handler() in the caller's task
+ *
+ *         Handlers registered by routing release their request memory when they return. For handlers registered
+ *         directly, the memory of the previous request is released here. Only in the server task, because no
+ *         handler is running there while it matches URIs.
+ */
+static bool hts_uri_match(const char *uri_template, const char *uri_to_match, size_t match_upto) {
+  if (Server_task == xTaskGetCurrentTaskHandle())
+    Req_arena.reset();
+  return httpd_uri_match_wildcard(uri_template, uri_to_match, match_upto);
+}
+
 static httpd_handle_t start_webserver(struct cfg_http *c) {
-  auth_user = c->user;
-  auth_password = c->password;
+  if (!auth_setup(c->user, c->password)) {
+    ESP_LOGE(TAG, "server start failed: invalid login data");
+    return NULL;
+  }
+  auth_token_setup(c->token_lifetime);
 
   httpd_handle_t server = NULL;
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-  config.stack_size += 1024;
-  config.max_open_sockets = 6;
-  config.uri_match_fn = httpd_uri_match_wildcard;
+  config.stack_size += c->stack_size_extra;
+  config.max_open_sockets = MIN(c->max_open_sockets, CONFIG_LWIP_MAX_SOCKETS - 3);
+  config.lru_purge_enable = c->lru_purge;
+  config.uri_match_fn = hts_uri_match;
+  config.open_fn = hts_open_fn;
+  config.close_fn = hts_close_fn;
+
+  Stats = {};
+  Stats.open_max = config.max_open_sockets;
 
-  ESP_LOGI(TAG, "start server. port=%d", config.server_port);
+  ESP_LOGI(TAG, "start server. port=%d, max_open_sockets=%d", config.server_port, config.max_open_sockets);
   if (httpd_start(&server, &config) != ESP_OK) {
     ESP_LOGE(TAG, "server start failed");
     return NULL;
   }
+
+  if (*CONFIG_NET_HTTP_SERVER_STATS_URI) {
+    httpd_uri_t stats_uri = { .uri = CONFIG_NET_HTTP_SERVER_STATS_URI, .method = HTTP_GET, .handler = handle_uri_stats, .user_ctx = NULL };
+    httpd_register_uri_handler(server, &stats_uri);
+  }
+  sse_register_uri(server);
+  routes_clear();
+  Routes_deferred = true;
   if (hts_register_uri_handlers_cb)
     hts_register_uri_handlers_cb(server);
+  Routes_deferred = false;
+
+  // register dispatchers last, so they don't hide any URI handlers registered directly
+  for (auto &rt : Route_tables) {
+    if (rt.method != -1 && ESP_OK != route_register_dispatcher(server, rt))
+      ESP_LOGE(TAG, "routing: cannot register dispatcher");
+  }
   return server;
 }
 
 ///////// public interface ///////////////////
 httpd_handle_t hts_server;
+
+bool hts_get_stats(struct hts_stats *stats) {
+  if (!hts_server)
+    return false;
+  *stats = Stats;
+  return true;
+}
+static struct cfg_http Server_cfg; ///< last configuration passed to hts_enable_http_server()
+
+static void stop_webserver() {
+  if (hts_server) {
+    ESP_LOGI(TAG, "stop server");
+    httpd_stop(hts_server);
+    hts_server = NULL;
+    Server_task = NULL;
+  }
+}
+
+/// \brief stop the server on losing the IP address. Start it again on the next one, if still enabled
+static void hts_ipnet_event(unsigned events, void *arg) {
+  if (events & IPNET_EVENT_LOST_IP)
+    stop_webserver();
+  if (Server_cfg.enable && ipnet_isConnected() && !hts_server)
+    hts_server = start_webserver(&Server_cfg);
+}
+
 void hts_enable_http_server(struct cfg_http *c) {
+  static bool subscribed;
+  if (!subscribed)
+    subscribed = ipnet_event_subscribe(IPNET_EVENT_GOT_IP | IPNET_EVENT_LOST_IP, hts_ipnet_event, nullptr);
 
+  if (c)
+    Server_cfg = *c;
+  else
+    Server_cfg.enable = false;
 
-  if (c && c->enable) {
+  if (Server_cfg.enable) {
     if (!hts_server)
-      hts_server = start_webserver(c);
+      hts_server = start_webserver(&Server_cfg);
   } else {
-    if (hts_server) {
-      ESP_LOGI(TAG, "stop server");
-      httpd_stop(hts_server);
-      hts_server = NULL;
-    }
+    stop_webserver();
   }
 }
 
@@ -0,0 +1,152 @@
+#include "http_server_impl.h"
+#include "net_http_server/http_server_setup.h"
+#include "net_http_server/esp32/http_server_esp32.h"
+
+#include <esp_log.h>
+#include <sys/param.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "http_server";
+#ifdef CONFIG_NET_HTTP_SERVER_DEBUG
+#define DEBUG
+#define D(x) x
+#else
+#define D(x)
+#endif
+
+#define SSE_CLIENTS_MAX CONFIG_NET_HTTP_SERVER_MAX_OPEN_SOCKETS
+#define SSE_REPLAY_COUNT CONFIG_NET_HTTP_SERVER_SSE_REPLAY_COUNT
+
+/*
+ * All data below is only accessed by the server task
+ * (URI handler, close_fn and work queued by httpd_queue_work)
+ */
+struct sse_event {
+  uint32_t id;
+  char *data;
+  size_t len;
+};
+
+static sse_event Replay[SSE_REPLAY_COUNT]; ///< ring buffer of the latest events for Last-Event-ID resume
+static uint32_t Last_id;
+static int Sse_fds[SSE_CLIENTS_MAX];
+
+static bool sse_send_event(httpd_handle_t hd, int fd, const sse_event &evt) {
+  char id_line[24];
+  const int id_len = snprintf(id_line, sizeof id_line, "id: %lu\n", (unsigned long) evt.id);
+  if (httpd_socket_send(hd, fd, id_line, id_len, 0) < 0)
+    return false;
+
+  // each line of data needs its own "data:" field
+  for (const char *p = evt.data, *end = evt.data + evt.len; p < end;) {
+    const char *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    const size_t line_len = (eol ? eol : end) - p;
+    if (httpd_socket_send(hd, fd, "data: ", 6, 0) < 0 || httpd_socket_send(hd, fd, p, line_len, 0) < 0 || httpd_socket_send(hd, fd, "\n", 1, 0) < 0)
+      return false;
+    p += line_len + 1;
+  }
+  return httpd_socket_send(hd, fd, "\n", 1, 0) >= 0;
+}
+
+static void sse_async_broadcast(void *arg) {
+  auto evt = static_cast<sse_event*>(arg);
+  evt->id = ++Last_id;
+
+  for (auto &fd : Sse_fds) {
+    if (fd < 0)
+      continue;
+    if (!sse_send_event(hts_server, fd, *evt)) {
+      ESP_LOGE(TAG, "SSE: send failed. fd=%d", fd);
+      fd = -1;
+    }
+  }
+
+  auto &slot = Replay[evt->id % SSE_REPLAY_COUNT];
+  free(slot.data);
+  slot = *evt;
+  free(evt);
+}
+
+static esp_err_t handle_uri_sse(httpd_req_t *req) {
+  if (!check_access_allowed(req))
+    return ESP_OK;
+
+  int *slot = nullptr;
+  for (auto &fd : Sse_fds) {
+    if (fd < 0) {
+      slot = &fd;
+      break;
+    }
+  }
+  if (!slot)
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "too many SSE clients");
+
+  // the response never ends, so send the header ourselves
+  static const char hdr[] = "HTTP/1.1 200 OK\r\n"
+      "Content-Type: text/event-stream\r\n"
+      "Cache-Control: no-cache\r\n"
+      "X-Accel-Buffering: no\r\n"
+      "\r\n";
+  if (httpd_send(req, hdr, sizeof hdr - 1) < 0)
+    return ESP_FAIL;
+
+  const int sockfd = httpd_req_to_sockfd(req);
+
+  // resume: replay events the client has missed (if still in buffer)
+  char last_id_str[12];
+  if (ESP_OK == httpd_req_get_hdr_value_str(req, "Last-Event-ID", last_id_str, sizeof last_id_str)) {
+    const uint32_t last_id = strtoul(last_id_str, nullptr, 10);
+    const uint32_t first_id = Last_id >= SSE_REPLAY_COUNT ? Last_id - SSE_REPLAY_COUNT + 1 : 1;
+    for (uint32_t id = MAX(last_id + 1, first_id); id <= Last_id; ++id) {
+      const auto &evt = Replay[id % SSE_REPLAY_COUNT];
+      if (evt.id == id && !sse_send_event(req->handle, sockfd, evt))
+        return ESP_FAIL;
+    }
+  }
+
+  *slot = sockfd;
+  D(ESP_LOGI(TAG, "SSE: client connected. fd=%d", sockfd));
+  return ESP_OK;
+}
+
+void sse_send_json(const char *json, ssize_t len) {
+  if (!hts_server || !*CONFIG_NET_HTTP_SERVER_SSE_URI)
+    return;
+
+  const size_t json_len = len >= 0 ? len : strlen(json);
+  auto evt = static_cast<sse_event*>(malloc(sizeof(sse_event)));
+  if (!evt)
+    return;
+  if (!(evt->data = static_cast<char*>(malloc(json_len)))) {
+    free(evt);
+    return;
+  }
+  memcpy(evt->data, json, json_len);
+  evt->len = json_len;
+  if (ESP_OK != httpd_queue_work(hts_server, sse_async_broadcast, evt)) {
+    free(evt->data);
+    free(evt);
+  }
+}
+
+void sse_forget(int sockfd) {
+  for (auto &fd : Sse_fds) {
+    if (fd == sockfd)
+      fd = -1;
+  }
+}
+
+void sse_register_uri(httpd_handle_t server) {
+  for (auto &fd : Sse_fds)
+    fd = -1;
+  for (auto &evt : Replay) {
+    free(evt.data);
+    evt = {};
+  }
+
+  if (!*CONFIG_NET_HTTP_SERVER_SSE_URI)
+    return;
+  httpd_uri_t sse_uri = { .uri = CONFIG_NET_HTTP_SERVER_SSE_URI, .method = HTTP_GET, .handler = handle_uri_sse, .user_ctx = NULL };
+  httpd_register_uri_handler(server, &sse_uri);
+}
@@ -97,3 +97,71 @@ int ws_write(void *req, const char *s, ssize_t s_len, int chunk_status) {
   return len;
 }
 
+
+WsStreamWriter::WsStreamWriter(void *req, unsigned buf_size) :
+    m_req(req), m_buf(static_cast<char*>(malloc(buf_size))), m_buf_size(m_buf ? buf_size : 0) {
+  if (!m_buf) {
+    ESP_LOGE(TAG, "WsStreamWriter: out of memory. Sending unbuffered");
+  }
+}
+
+WsStreamWriter::~WsStreamWriter() {
+  finish();
+  free(m_buf);
+}
+
+bool WsStreamWriter::send_fragment(bool final) {
+  if (m_error)
+    return false;
+
+  int chunk_status;
+  if (final)
+    chunk_status = m_fragment_count ? m_fragment_count + 1 : 0;
+  else
+    chunk_status = m_fragment_count ? -2 : -1;
+
+  if (ws_write(m_req, m_buf ? m_buf : "", m_buf_idx, chunk_status) < 0) {
+    m_error = true;
+    return false;
+  }
+  ++m_fragment_count;
+  m_buf_idx = 0;
+  return true;
+}
+
+int WsStreamWriter::write(const char *s, ssize_t s_len) {
+  if (m_error || m_finished)
+    return -1;
+
+  const size_t len = s_len < 0 ? strlen(s) : (size_t) s_len;
+
+  // no buffer available: send each write as a fragment of its own
+  if (!m_buf) {
+    if (ws_write(m_req, s, len, m_fragment_count ? -2 : -1) < 0) {
+      m_error = true;
+      return -1;
+    }
+    ++m_fragment_count;
+    return len;
+  }
+
+  for (size_t remaining = len; remaining;) {
+    // keep the last fragment in buffer, so finish() has something to send as final fragment
+    if (m_buf_idx == m_buf_size && !send_fragment(false))
+      return -1;
+
+    const size_t n = MIN(remaining, m_buf_size - m_buf_idx);
+    memcpy(m_buf + m_buf_idx, s, n);
+    m_buf_idx += n;
+    s += n;
+    remaining -= n;
+  }
+  return len;
+}
+
+bool WsStreamWriter::finish() {
+  if (m_finished)
+    return !m_error;
+  m_finished = true;
+  return send_fragment(true);
+}
@@ -0,0 +1,1161 @@
+#include "http_server_impl.h"
+#include "auth_token.hh"
+#include "net_http_server/http_server_setup.h"
+#include "net_http_server/host/http_server_host.h"
+#include "net_http_server/uri_trie.hh"
+#include "net_http_server/req_arena.h"
+#include "net_http_server/req_view.hh"
+#include "req_arena.hh"
+
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+#include <mbedtls/sha256.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef CONFIG_NET_HTTP_SERVER_DEBUG
+#define DEBUG
+#define D(x) x
+#else
+#define D(x)
+#endif
+#define logtag "http_server"
+
+#define MAX_HEADER_LEN 8192  ///< maximal size of request line and headers
+#define MAX_BODY_LEN (1024 * 1024)
+#define EPOLL_EVENTS_MAX 64
+#define IOV_MAX_BATCH 64 ///< maximal number of buffers per writev() call
+#define SSE_REPLAY_COUNT CONFIG_NET_HTTP_SERVER_SSE_REPLAY_COUNT
+
+using hdr_list = std::vector<std::pair<std::string_view, std::string_view>>;
+
+/// \brief a client connection
+struct hts_conn {
+  explicit hts_conn(int fd) :
+      fd(fd) {
+  }
+  int fd;
+  std::string in;  ///< received data not yet processed
+  std::deque<std::string> out; ///< queued responses (or WebSocket frames) not yet sent
+  size_t out_pos = 0;  ///< number of bytes of out.front() already sent
+  bool keep_alive = true;
+  bool close_after_write = false;
+  bool peer_closed = false;
+  bool is_ws = false;
+  bool is_sse = false; ///< streaming Server-Sent-Events
+  httpd_uri_t ws_route = { }; ///< handler of the upgraded request (if is_ws)
+  std::string ws_uri;
+  uint64_t last_use = 0; ///< value of the server's activity counter at the last event (for LRU purge)
+};
+
+/// \brief private request data (pointed to by httpd_req::aux)
+struct req_ctx {
+  explicit req_ctx(hts_conn *conn) :
+      conn(conn) {
+  }
+  hts_conn *conn;
+  std::string uri;
+  std::string_view query;
+  hdr_list hdrs;
+  std::string_view body;
+  size_t body_read = 0;
+  const char *status = "200 OK";
+  const char *type = "text/html";
+  std::vector<std::pair<const char*, const char*>> resp_hdrs;
+  bool hdrs_sent = false;
+  bool head = false;  ///< HEAD request: send header only
+  bool chunked = false;
+  bool done = false;
+  const httpd_ws_frame_t *ws_frame = nullptr; ///< data frame a WebSocket handler is called for
+};
+
+static bool is_equal_nocase(std::string_view a, std::string_view b) {
+  return a.size() == b.size() && 0 == strncasecmp(a.data(), b.data(), a.size());
+}
+
+static const std::string_view* find_hdr(const hdr_list &hdrs, std::string_view name) {
+  for (auto &it : hdrs) {
+    if (is_equal_nocase(it.first, name))
+      return &it.second;
+  }
+  return nullptr;
+}
+
+static req_ctx& ctx_of(httpd_req_t *r) {
+  return *static_cast<req_ctx*>(r->aux);
+}
+
+static int set_nonblocking(int fd) {
+  return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+/**
+ * \brief  HTTP/1.1 server running an epoll event loop in its own thread
+ */
+class HtsHostServer {
+public:
+  /**
+   * \param max_open   maximal number of open connections (cfg_http::max_open_sockets)
+   * \param lru_purge  if all connections are in use, close the least recently used one to accept a new one
+   */
+  HtsHostServer(unsigned max_open, bool lru_purge) :
+      m_lru_purge(lru_purge) {
+    m_stats.open_max = max_open ? max_open : 1;
+  }
+  ~HtsHostServer() {
+    stop();
+  }
+
+public:
+  bool start(unsigned port) {
+    if ((m_listen_fd = socket(AF_INET6, SOCK_STREAM, 0)) < 0) {
+      perror(logtag ": socket");
+      return false;
+    }
+    int on = 1, off = 0;
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    setsockopt(m_listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof off);
+
+    struct sockaddr_in6 self = { };
+    self.sin6_family = AF_INET6;
+    self.sin6_port = htons(port);
+    self.sin6_addr = in6addr_any;
+    if (bind(m_listen_fd, (struct sockaddr*) &self, sizeof self) < 0 || listen(m_listen_fd, SOMAXCONN) < 0 || set_nonblocking(m_listen_fd) < 0) {
+      perror(logtag ": bind/listen");
+      return false;
+    }
+
+    if ((m_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 || (m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+      perror(logtag ": epoll/eventfd");
+      return false;
+    }
+    epoll_add(m_listen_fd, EPOLLIN);
+    epoll_add(m_event_fd, EPOLLIN);
+
+    m_thread = std::thread([this] {
+      event_loop();
+    });
+    return true;
+  }
+
+  void stop() {
+    if (m_thread.joinable()) {
+      m_stop = true;
+      wakeup();
+      m_thread.join();
+    }
+    for (auto &it : m_conns)
+      ::close(it.first);
+    m_conns.clear();
+    for (int *fdp : { &m_listen_fd, &m_epoll_fd, &m_event_fd }) {
+      if (*fdp >= 0)
+        ::close(*fdp);
+      *fdp = -1;
+    }
+  }
+
+  esp_err_t register_uri_handler(const httpd_uri_t *uri_handler) {
+    auto &routes = m_routes[uri_handler->method & 7];
+    return routes.add(uri_handler->uri, *uri_handler) ? ESP_OK : ESP_ERR_HTTPD_HANDLER_EXISTS;
+  }
+
+  /// \brief queue text message to be sent to all WebSocket clients (thread safe)
+  void ws_broadcast(const char *json, size_t len) {
+    {
+      std::lock_guard<std::mutex> lock(m_push_mutex);
+      m_ws_queue.emplace_back(json, len);
+    }
+    wakeup();
+  }
+
+  /// \brief queue event to be sent to all Server-Sent-Events clients (thread safe)
+  void sse_broadcast(const char *json, size_t len) {
+    {
+      std::lock_guard<std::mutex> lock(m_push_mutex);
+      m_sse_queue.emplace_back(json, len);
+    }
+    wakeup();
+  }
+
+  /// \brief turn the connection of CTX into an event stream and replay the events after its Last-Event-ID
+  void sse_attach(req_ctx &ctx) {
+    auto &out = ctx.conn->out.emplace_back("HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "X-Accel-Buffering: no\r\n"
+        "\r\n");
+    ctx.hdrs_sent = true;
+    ctx.done = true;
+    ctx.conn->is_sse = true;
+    ctx.conn->keep_alive = true; // the stream ends when the client closes it
+
+    if (auto last = find_hdr(ctx.hdrs, "Last-Event-ID")) {
+      const uint32_t last_id = strtoul(std::string(*last).c_str(), nullptr, 10);
+      for (auto &evt : m_sse_replay) {
+        if (evt.first > last_id)
+          sse_append_event(out, evt.first, evt.second);
+      }
+    }
+  }
+
+  void get_stats(hts_stats *stats) {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    *stats = m_stats;
+  }
+
+  /// \brief memory of the request being handled (requests are handled one at a time by the server thread)
+  ReqArena& req_arena() {
+    return m_req_arena;
+  }
+
+public:
+  /// \brief append response header to connection output (first part of every response)
+  void resp_begin(req_ctx &ctx, ssize_t content_length) {
+    auto &out = ctx.conn->out.emplace_back();
+    out.append("HTTP/1.1 ").append(ctx.status).append("\r\n");
+    if (ctx.type)
+      out.append("Content-Type: ").append(ctx.type).append("\r\n");
+    for (auto &it : ctx.resp_hdrs)
+      out.append(it.first).append(": ").append(it.second).append("\r\n");
+    if (content_length < 0) {
+      out.append("Transfer-Encoding: chunked\r\n");
+      ctx.chunked = true;
+    } else {
+      out.append("Content-Length: ").append(std::to_string(content_length)).append("\r\n");
+    }
+    if (!ctx.conn->keep_alive)
+      out.append("Connection: close\r\n");
+    out.append("\r\n");
+    ctx.hdrs_sent = true;
+  }
+
+private:
+  void wakeup() {
+    uint64_t one = 1;
+    if (write(m_event_fd, &one, sizeof one) < 0) {
+      D(perror(logtag ": eventfd write"));
+    }
+  }
+
+  void epoll_add(int fd, uint32_t events) {
+    struct epoll_event ev = { };
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  void epoll_mod(int fd, uint32_t events) {
+    struct epoll_event ev = { };
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+  }
+
+  void event_loop() {
+    struct epoll_event events[EPOLL_EVENTS_MAX];
+    while (!m_stop) {
+      const int n = epoll_wait(m_epoll_fd, events, EPOLL_EVENTS_MAX, -1);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        perror(logtag ": epoll_wait");
+        break;
+      }
+      m_batch = events;
+      m_batch_n = n;
+      for (m_batch_pos = 0; m_batch_pos < n; ++m_batch_pos) {
+        const int i = m_batch_pos;
+        const int fd = events[i].data.fd;
+        if (fd < 0) {
+          continue; // connection was closed while handling this batch
+        } else if (fd == m_listen_fd) {
+          accept_all();
+        } else if (fd == m_event_fd) {
+          uint64_t count;
+          if (read(m_event_fd, &count, sizeof count) < 0) {
+            D(perror(logtag ": eventfd read"));
+          }
+          flush_push_queues();
+        } else if (auto it = m_conns.find(fd); it != m_conns.end()) {
+          handle_conn_event(it->second, events[i].events);
+        }
+      }
+      m_batch_n = 0;
+    }
+  }
+
+  void accept_all() {
+    for (;;) {
+      const int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+          perror(logtag ": accept");
+        return;
+      }
+      if (m_conns.size() >= m_stats.open_max) {
+        hts_conn *lru = nullptr;
+        for (auto &it : m_conns) {
+          if (it.second.is_sse)
+            continue; // an event stream may be idle for a long time, but is still in use
+          if (!lru || it.second.last_use < lru->last_use)
+            lru = &it.second;
+        }
+        if (!m_lru_purge || !lru) {
+          ::close(fd); // limit reached
+          continue;
+        }
+        close_conn(*lru);
+      }
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+      m_conns.emplace(fd, hts_conn(fd)).first->second.last_use = ++m_use_counter;
+      epoll_add(fd, EPOLLIN | EPOLLRDHUP);
+
+      std::lock_guard<std::mutex> lock(m_stats_mutex);
+      ++m_stats.accepted;
+      if (++m_stats.open > m_stats.open_peak)
+        m_stats.open_peak = m_stats.open;
+    }
+  }
+
+  void close_conn(hts_conn &conn) {
+    const int fd = conn.fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    m_conns.erase(fd);
+    // drop pending events of this batch. A connection accepted later in the batch may get the same fd
+    for (int i = m_batch_pos + 1; i < m_batch_n; ++i) {
+      if (m_batch[i].data.fd == fd)
+        m_batch[i].data.fd = -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    ++m_stats.closed;
+    --m_stats.open;
+  }
+
+  void handle_conn_event(hts_conn &conn, uint32_t events) {
+    conn.last_use = ++m_use_counter;
+    if (events & (EPOLLERR | EPOLLHUP)) {
+      close_conn(conn);
+      return;
+    }
+
+    if (events & EPOLLIN) {
+      char buf[4096];
+      for (;;) {
+        const ssize_t n = ::read(conn.fd, buf, sizeof buf);
+        if (n > 0) {
+          conn.in.append(buf, n);
+          continue;
+        }
+        if (n == 0) {
+          conn.peer_closed = true;
+          break;
+        }
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          close_conn(conn);
+          return;
+        }
+        break;
+      }
+      if (!conn.is_ws && !conn.is_sse)
+        process_input(conn);
+      if (conn.is_ws)
+        ws_process_input(conn); // also data sent right after the upgrade request
+      else if (conn.is_sse)
+        conn.in.clear(); // SSE clients don't send anything after their request
+      if (conn.peer_closed)
+        conn.close_after_write = true;
+    }
+
+    if (!flush(conn))
+      return; // connection was closed
+  }
+
+  /**
+   * \brief   write pending output
+   * \return  false if connection was closed
+   */
+  bool flush(hts_conn &conn) {
+    while (!conn.out.empty()) {
+      struct iovec iov[IOV_MAX_BATCH];
+      int iovcnt = 0;
+      for (auto it = conn.out.begin(); it != conn.out.end() && iovcnt < IOV_MAX_BATCH; ++it) {
+        const size_t off = iovcnt ? 0 : conn.out_pos;
+        iov[iovcnt++] = { const_cast<char*>(it->data()) + off, it->size() - off };
+      }
+
+      ssize_t n = ::writev(conn.fd, iov, iovcnt);
+      if (n >= 0) {
+        // drop all buffers written completely
+        while (!conn.out.empty() && size_t(n) >= conn.out.front().size() - conn.out_pos) {
+          n -= conn.out.front().size() - conn.out_pos;
+          conn.out.pop_front();
+          conn.out_pos = 0;
+        }
+        conn.out_pos += n;
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        epoll_mod(conn.fd, conn.peer_closed ? EPOLLOUT : EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+        return true;
+      }
+      if (errno == EINTR)
+        continue;
+      close_conn(conn);
+      return false;
+    }
+    if (conn.close_after_write) {
+      close_conn(conn);
+      return false;
+    }
+    epoll_mod(conn.fd, EPOLLIN | EPOLLRDHUP);
+    return true;
+  }
+
+  /**
+   * \brief  process all complete (pipelined) requests in input buffer
+   *
+   *         Responses are queued in order and sent together by \ref flush
+   */
+  void process_input(hts_conn &conn) {
+    size_t consumed = 0;
+    while (!conn.close_after_write && !conn.is_ws && !conn.is_sse) {
+      const size_t n = process_request(conn, std::string_view(conn.in).substr(consumed));
+      if (!n)
+        break;
+      consumed += n;
+    }
+    conn.in.erase(0, consumed);
+  }
+
+  /**
+   * \brief     parse and handle the first request in IN
+   * \return    number of bytes consumed or 0 if the request is not yet complete (or the connection will be closed)
+   */
+  size_t process_request(hts_conn &conn, std::string_view in) {
+    const size_t hdr_end = in.find("\r\n\r\n");
+    if (hdr_end == std::string_view::npos) {
+      if (in.size() > MAX_HEADER_LEN)
+        send_error_and_close(conn, "431 Request Header Fields Too Large");
+      return 0;
+    }
+
+    const std::string_view head = in.substr(0, hdr_end + 2);
+    req_ctx ctx(&conn);
+    std::string_view method, target, version;
+
+    // request line
+    size_t pos = head.find("\r\n");
+    {
+      const std::string_view line = head.substr(0, pos);
+      const size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+      if (sp1 == std::string_view::npos || sp1 == sp2) {
+        send_error_and_close(conn, "400 Bad Request");
+        return 0;
+      }
+      method = line.substr(0, sp1);
+      target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+      version = line.substr(sp2 + 1);
+    }
+
+    // header lines
+    for (pos += 2; pos < head.size();) {
+      const size_t eol = head.find("\r\n", pos);
+      const std::string_view line = head.substr(pos, eol - pos);
+      pos = eol + 2;
+      const size_t colon = line.find(':');
+      if (colon == std::string_view::npos)
+        continue;
+      std::string_view value = line.substr(colon + 1);
+      while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+        value.remove_prefix(1);
+      while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+        value.remove_suffix(1);
+      ctx.hdrs.emplace_back(line.substr(0, colon), value);
+    }
+
+    size_t body_len = 0;
+    if (auto cl = find_hdr(ctx.hdrs, "Content-Length")) {
+      body_len = strtoul(std::string(*cl).c_str(), nullptr, 10);
+      if (body_len > MAX_BODY_LEN) {
+        send_error_and_close(conn, "413 Content Too Large");
+        return 0;
+      }
+    } else if (find_hdr(ctx.hdrs, "Transfer-Encoding")) {
+      send_error_and_close(conn, "411 Length Required");
+      return 0;
+    }
+    const size_t req_len = hdr_end + 4 + body_len;
+    if (in.size() < req_len)
+      return 0; // wait for body
+    ctx.body = in.substr(hdr_end + 4, body_len);
+
+    auto conn_hdr = find_hdr(ctx.hdrs, "Connection");
+    if (version == "HTTP/1.0")
+      conn.keep_alive = conn_hdr && is_equal_nocase(*conn_hdr, "keep-alive");
+    else
+      conn.keep_alive = !(conn_hdr && is_equal_nocase(*conn_hdr, "close"));
+
+    handle_request(ctx, method, target);
+
+    if (!conn.keep_alive)
+      conn.close_after_write = true;
+    return req_len;
+  }
+
+  void send_error_and_close(hts_conn &conn, const char *status) {
+    req_ctx ctx(&conn);
+    ctx.status = status;
+    ctx.type = nullptr;
+    conn.keep_alive = false;
+    resp_begin(ctx, 0);
+    conn.close_after_write = true;
+  }
+
+  static int parse_method(std::string_view method) {
+    static const std::pair<const char*, httpd_method_t> methods[] = { { "GET", HTTP_GET }, { "HEAD", HTTP_HEAD }, { "POST", HTTP_POST }, { "PUT", HTTP_PUT }, {
+        "DELETE", HTTP_DELETE }, { "OPTIONS", HTTP_OPTIONS } };
+    for (auto &it : methods) {
+      if (method == it.first)
+        return it.second;
+    }
+    return -1;
+  }
+
+  void handle_request(req_ctx &ctx, std::string_view method_str, std::string_view target) {
+    hts_conn &conn = *ctx.conn;
+    const int method = parse_method(method_str);
+    if (method < 0) {
+      send_error_and_close(conn, "501 Not Implemented");
+      return;
+    }
+
+    ctx.uri = std::string(target);
+    if (auto q = target.find('?'); q != std::string_view::npos)
+      ctx.query = std::string_view(ctx.uri).substr(q + 1);
+
+    const httpd_uri_t *route = m_routes[method].find(ctx.uri.data(), ctx.uri.size());
+    if (method == HTTP_HEAD) {
+      ctx.head = true;
+      if (!route)
+        route = m_routes[HTTP_GET].find(ctx.uri.data(), ctx.uri.size());
+    }
+    if (!route) {
+      D(fprintf(stderr, logtag ": no handler for <%s>\n", ctx.uri.c_str()));
+      ctx.status = "404 Not Found";
+      resp_begin(ctx, 0);
+      return;
+    }
+
+    if (route->is_websocket) {
+      ws_upgrade(ctx, method, *route);
+      return;
+    }
+
+    httpd_req_t req = { .handle = this, .method = method, .uri = ctx.uri.c_str(), .content_len = ctx.body.size(), .user_ctx = route->user_ctx, .aux = &ctx };
+    const esp_err_t res = route->handler(&req);
+
+    // like esp_http_server: close connection if handler fails. Also close if response is incomplete
+    if (res != ESP_OK || !ctx.hdrs_sent || (ctx.chunked && !ctx.done)) {
+      if (!ctx.hdrs_sent) {
+        ctx.status = "500 Internal Server Error";
+        resp_begin(ctx, 0);
+      }
+      conn.keep_alive = false;
+    }
+    hts_req_free_all(&req);
+  }
+
+  //////////////////////////WebSocket//////////////////////
+  void ws_upgrade(req_ctx &ctx, int method, const httpd_uri_t &route) {
+    if (method != HTTP_GET) {
+      ctx.status = "405 Method Not Allowed";
+      resp_begin(ctx, 0);
+      return;
+    }
+    auto upgrade = find_hdr(ctx.hdrs, "Upgrade");
+    auto key = find_hdr(ctx.hdrs, "Sec-WebSocket-Key");
+    if (!upgrade || !is_equal_nocase(*upgrade, "websocket") || !key || key->size() > 64) {
+      ctx.status = "400 Bad Request";
+      resp_begin(ctx, 0);
+      return;
+    }
+
+    std::string accept_src(*key);
+    accept_src.append("258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    unsigned char sha1[20];
+    unsigned char accept[32];
+    size_t olen = 0;
+    mbedtls_sha1((const unsigned char*) accept_src.data(), accept_src.size(), sha1);
+    mbedtls_base64_encode(accept, sizeof accept, &olen, sha1, sizeof sha1);
+
+    auto &out = ctx.conn->out.emplace_back();
+    out.append("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ");
+    out.append((const char*) accept, olen).append("\r\n\r\n");
+    ctx.hdrs_sent = true;
+    ctx.conn->is_ws = true;
+    ctx.conn->ws_route = route;
+    ctx.conn->ws_uri = ctx.uri;
+
+    // like esp_http_server: call handler once after the handshake
+    httpd_req_t req = { .handle = this, .method = HTTP_GET, .uri = ctx.uri.c_str(), .content_len = 0, .user_ctx = route.user_ctx, .aux = &ctx };
+    if (route.handler(&req) != ESP_OK)
+      ctx.conn->close_after_write = true;
+    hts_req_free_all(&req);
+  }
+
+  /// \brief call WebSocket handler of CONN for data FRAME
+  void ws_call_handler(hts_conn &conn, const httpd_ws_frame_t &frame) {
+    req_ctx ctx(&conn);
+    ctx.uri = conn.ws_uri;
+    ctx.hdrs_sent = true; // no HTTP response on an upgraded connection
+    ctx.ws_frame = &frame;
+    httpd_req_t req = { .handle = this, .method = 0, .uri = ctx.uri.c_str(), .content_len = frame.len, .user_ctx = conn.ws_route.user_ctx, .aux = &ctx };
+    if (conn.ws_route.handler(&req) != ESP_OK)
+      conn.close_after_write = true;
+    hts_req_free_all(&req);
+  }
+
+public:
+  static void ws_append_frame(std::string &out, uint8_t opcode, const char *data, size_t len, bool final = true) {
+    out.push_back((final ? 0x80 : 0) | opcode);
+    if (len < 126) {
+      out.push_back(len);
+    } else if (len < 0x10000) {
+      out.push_back(126);
+      out.push_back(len >> 8);
+      out.push_back(len);
+    } else {
+      out.push_back(127);
+      for (int i = 7; i >= 0; --i)
+        out.push_back(uint64_t(len) >> (i * 8));
+    }
+    out.append(data, len);
+  }
+
+private:
+  /// \brief handle control frames from client and pass data frames to the WebSocket handler
+  void ws_process_input(hts_conn &conn) {
+    while (!conn.close_after_write) {
+      const auto *p = (const uint8_t*) conn.in.data();
+      const size_t avail = conn.in.size();
+      if (avail < 2)
+        return;
+      const bool final = p[0] & 0x80;
+      const uint8_t opcode = p[0] & 0x0f;
+      const bool masked = p[1] & 0x80;
+      uint64_t len = p[1] & 0x7f;
+      size_t hdr_len = 2;
+      if (len == 126) {
+        if (avail < 4)
+          return;
+        len = (p[2] << 8) | p[3];
+        hdr_len = 4;
+      } else if (len == 127) {
+        if (avail < 10)
+          return;
+        len = 0;
+        for (int i = 0; i < 8; ++i)
+          len = (len << 8) | p[2 + i];
+        hdr_len = 10;
+      }
+      if (len > MAX_BODY_LEN) {
+        conn.close_after_write = true;
+        return;
+      }
+      const size_t frame_len = hdr_len + (masked ? 4 : 0) + len;
+      if (avail < frame_len)
+        return;
+
+      std::string payload(conn.in.data() + hdr_len + (masked ? 4 : 0), len);
+      if (masked) {
+        for (size_t i = 0; i < len; ++i)
+          payload[i] ^= p[hdr_len + (i & 3)];
+      }
+      conn.in.erase(0, frame_len);
+
+      if (opcode == 0x8) { // close
+        ws_append_frame(conn.out.emplace_back(), 0x8, payload.data(), payload.size() < 2 ? payload.size() : 2);
+        conn.close_after_write = true;
+        return;
+      }
+      if (opcode == 0x9) { // ping
+        ws_append_frame(conn.out.emplace_back(), 0xA, payload.data(), payload.size());
+        continue;
+      }
+      if (opcode == 0xA) // pong
+        continue;
+
+      httpd_ws_frame_t frame = { .final = final, .fragmented = !final || opcode == HTTPD_WS_TYPE_CONTINUE, .type = httpd_ws_type_t(opcode),
+          .payload = (uint8_t*) payload.data(), .len = payload.size() };
+      ws_call_handler(conn, frame);
+    }
+  }
+
+  //////////////////////////Server-Sent-Events//////////////////////
+  static void sse_append_event(std::string &out, uint32_t id, std::string_view data) {
+    out.append("id: ").append(std::to_string(id)).append("\n");
+    // each line of data needs its own "data:" field
+    for (size_t pos = 0; pos < data.size();) {
+      const size_t eol = std::min(data.find('\n', pos), data.size());
+      out.append("data: ").append(data.substr(pos, eol - pos)).append("\n");
+      pos = eol + 1;
+    }
+    out.append("\n");
+  }
+
+  /// \brief send messages queued by other threads to the WebSocket and SSE clients
+  void flush_push_queues() {
+    std::vector<std::string> ws_queue, sse_queue;
+    {
+      std::lock_guard<std::mutex> lock(m_push_mutex);
+      ws_queue.swap(m_ws_queue);
+      sse_queue.swap(m_sse_queue);
+    }
+    if (ws_queue.empty() && sse_queue.empty())
+      return;
+
+    std::string sse_out;
+    for (auto &json : sse_queue) {
+      sse_append_event(sse_out, ++m_sse_last_id, json);
+      if (m_sse_replay.size() == SSE_REPLAY_COUNT)
+        m_sse_replay.pop_front();
+      m_sse_replay.emplace_back(m_sse_last_id, std::move(json));
+    }
+
+    std::vector<int> fds;
+    for (auto &it : m_conns) {
+      if ((it.second.is_ws && !ws_queue.empty()) || (it.second.is_sse && !sse_out.empty()))
+        fds.push_back(it.first);
+    }
+    for (int fd : fds) {
+      auto &conn = m_conns.at(fd);
+      if (conn.is_sse) {
+        conn.out.push_back(sse_out);
+      } else {
+        auto &out = conn.out.emplace_back();
+        for (auto &json : ws_queue)
+          ws_append_frame(out, 0x1, json.data(), json.size());
+      }
+      flush(conn);
+    }
+  }
+
+private:
+  int m_listen_fd = -1;
+  int m_epoll_fd = -1;
+  int m_event_fd = -1;
+  std::atomic<bool> m_stop { false };
+  std::thread m_thread;
+  std::unordered_map<int, hts_conn> m_conns;
+  const bool m_lru_purge;
+  uint64_t m_use_counter = 0; ///< incremented on each connection event
+  struct epoll_event *m_batch = nullptr; ///< events returned by the current epoll_wait()
+  int m_batch_n = 0, m_batch_pos = 0;
+  UriTrie<httpd_uri_t> m_routes[8];
+  std::mutex m_push_mutex; ///< protects m_ws_queue and m_sse_queue
+  std::vector<std::string> m_ws_queue;
+  std::vector<std::string> m_sse_queue;
+  std::deque<std::pair<uint32_t, std::string>> m_sse_replay; ///< latest events for Last-Event-ID resume
+  uint32_t m_sse_last_id = 0;
+  std::mutex m_stats_mutex;
+  hts_stats m_stats = { };
+  ReqArena m_req_arena { CONFIG_NET_HTTP_SERVER_REQ_ARENA_SIZE };
+};
+
+static HtsHostServer* server_of(httpd_req_t *r) {
+  return static_cast<HtsHostServer*>(r->handle);
+}
+
+ReqArena& hts_req_arena(struct httpd_req *req) {
+  return server_of(req)->req_arena();
+}
+
+//////////////////////////Authorization//////////////////////
+static bool auth_required;
+static uint32_t auth_token_lifetime;
+static uint8_t auth_digest[32]; ///< SHA-256 of the expected Authorization header value ("Basic base64(user:password)")
+
+static uint32_t uptime_s() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static bool ct_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; ++i)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+static bool auth_setup(const cfg_http *c) {
+  auth_required = !(*c->user == '\0' && *c->password == '\0');
+  auth_token_lifetime = c->token_lifetime;
+  if (!auth_required)
+    return true;
+
+  if (auth_token_lifetime) {
+    uint8_t key[32];
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (!fp || fread(key, sizeof key, 1, fp) != 1) {
+      if (fp)
+        fclose(fp);
+      return false;
+    }
+    fclose(fp);
+    authToken_setKey(key, sizeof key);
+  }
+
+  char up[sizeof cfg_http::user + sizeof cfg_http::password];
+  const int up_len = snprintf(up, sizeof up, "%s:%s", c->user, c->password);
+  if (up_len < 0 || up_len >= (int) sizeof up)
+    return false;
+
+  char hdr[6 + (sizeof up + 2) / 3 * 4 + 1] = "Basic ";
+  size_t olen = 0;
+  if (0 != mbedtls_base64_encode((unsigned char*) hdr + 6, sizeof hdr - 6, &olen, (const unsigned char*) up, up_len))
+    return false;
+
+  return 0 == mbedtls_sha256((const unsigned char*) hdr, 6 + olen, auth_digest, 0);
+}
+
+static bool verify_token_cookie(req_ctx &ctx) {
+  auto cookies = find_hdr(ctx.hdrs, "Cookie");
+  if (!cookies)
+    return false;
+  constexpr std::string_view name = AUTH_TOKEN_COOKIE "=";
+  for (size_t pos = 0; pos < cookies->size();) {
+    size_t end = cookies->find(';', pos);
+    if (end == std::string_view::npos)
+      end = cookies->size();
+    std::string_view cookie = cookies->substr(pos, end - pos);
+    while (!cookie.empty() && cookie.front() == ' ')
+      cookie.remove_prefix(1);
+    if (cookie.substr(0, name.size()) == name) {
+      cookie.remove_prefix(name.size());
+      return authToken_verify(cookie.data(), cookie.size(), uptime_s());
+    }
+    pos = end + 1;
+  }
+  return false;
+}
+
+static void auth_token_issue(httpd_req_t *req) {
+  char token[AUTH_TOKEN_LEN + 1];
+
+  if (!authToken_create(token, sizeof token, uptime_s() + auth_token_lifetime))
+    return;
+  // request memory stays valid until the response is sent
+  if (auto cookie = hts_req_printf(req, AUTH_TOKEN_COOKIE "=%s; Max-Age=%lu; Path=/; HttpOnly; SameSite=Strict", token, (unsigned long) auth_token_lifetime))
+    httpd_resp_set_hdr(req, "Set-Cookie", cookie);
+}
+
+static bool is_access_allowed(httpd_req_t *req) {
+  if (!auth_required)
+    return true;
+
+  auto &ctx = ctx_of(req);
+  if (auth_token_lifetime && verify_token_cookie(ctx))
+    return true;
+
+  auto login = find_hdr(ctx.hdrs, "Authorization");
+  if (!login)
+    return false;
+
+  if (auth_token_lifetime && login->substr(0, 7) == "Bearer ")
+    return authToken_verify(login->data() + 7, login->size() - 7, uptime_s());
+
+  uint8_t digest[sizeof auth_digest];
+  if (0 != mbedtls_sha256((const unsigned char*) login->data(), login->size(), digest, 0) || !ct_equal(digest, auth_digest, sizeof digest))
+    return false;
+
+  if (auth_token_lifetime)
+    auth_token_issue(req);
+  return true;
+}
+
+bool check_access_allowed(httpd_req_t *req) {
+  if (!is_access_allowed(req)) {
+    httpd_resp_set_status(req, "401 Unauthorized");
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"tronferno-mcu.all\"");
+    httpd_resp_sendstr(req, "<p>please login</p>");
+    fprintf(stderr, logtag ": connection refused. user not authorized.\n");
+    return false;
+  }
+  return true;
+}
+
+//////////////////////////esp_http_server compatible API//////////////////////
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+  if (!handle || !uri_handler || !uri_handler->uri)
+    return ESP_ERR_INVALID_ARG;
+  return static_cast<HtsHostServer*>(handle)->register_uri_handler(uri_handler);
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+  ctx_of(r).status = status;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+  ctx_of(r).type = type;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+  ctx_of(r).resp_hdrs.emplace_back(field, value);
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+  auto &ctx = ctx_of(r);
+  if (ctx.hdrs_sent)
+    return ESP_ERR_HTTPD_RESP_HDR;
+  if (buf_len == HTTPD_RESP_USE_STRLEN)
+    buf_len = buf ? strlen(buf) : 0;
+
+  server_of(r)->resp_begin(ctx, buf_len);
+  if (buf && buf_len && !ctx.head)
+    ctx.conn->out.emplace_back(buf, buf_len);
+  ctx.done = true;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+  auto &ctx = ctx_of(r);
+  if (ctx.done)
+    return ESP_ERR_HTTPD_RESP_SEND;
+  if (buf_len == HTTPD_RESP_USE_STRLEN)
+    buf_len = buf ? strlen(buf) : 0;
+
+  if (!ctx.hdrs_sent)
+    server_of(r)->resp_begin(ctx, -1);
+  if (!ctx.chunked)
+    return ESP_ERR_HTTPD_RESP_SEND;
+
+  if (ctx.head) {
+    ctx.done = buf_len == 0;
+    return ESP_OK;
+  }
+
+  char size_line[20];
+  snprintf(size_line, sizeof size_line, "%zx\r\n", (size_t) buf_len);
+  auto &out = ctx.conn->out.back();
+  out.append(size_line);
+  if (buf_len)
+    out.append(buf, buf_len);
+  out.append("\r\n");
+  if (buf_len == 0)
+    ctx.done = true;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+  static const char *const status[] = { "400 Bad Request", "401 Unauthorized", "403 Forbidden", "404 Not Found", "405 Method Not Allowed",
+      "408 Request Timeout", "411 Length Required", "414 URI Too Long", "431 Request Header Fields Too Large", "500 Internal Server Error",
+      "501 Method Not Implemented", "505 Version Not Supported" };
+  httpd_resp_set_status(req, status[error]);
+  httpd_resp_set_type(req, "text/html");
+  return httpd_resp_sendstr(req, msg ? msg : status[error]);
+}
+
+ReqView::ReqView(httpd_req_t *req) :
+    m_req(req) {
+  parse(req->uri);
+}
+
+std::string_view ReqView::header(const char *name) const {
+  auto value = find_hdr(ctx_of(m_req).hdrs, name);
+  return value ? *value : std::string_view();
+}
+
+char *hts_req_get_hdr(struct httpd_req *r, const char *field) {
+  auto value = find_hdr(ctx_of(r).hdrs, field);
+  return value ? hts_req_strndup(r, value->data(), value->size()) : nullptr;
+}
+
+char *hts_req_get_query(struct httpd_req *r) {
+  auto &ctx = ctx_of(r);
+  return ctx.query.empty() ? nullptr : hts_req_strndup(r, ctx.query.data(), ctx.query.size());
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+  auto value = find_hdr(ctx_of(r).hdrs, field);
+  return value ? value->size() : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+  auto value = find_hdr(ctx_of(r).hdrs, field);
+  if (!value)
+    return ESP_ERR_NOT_FOUND;
+  if (!val_size)
+    return ESP_ERR_INVALID_ARG;
+  const size_t n = std::min(value->size(), val_size - 1);
+  memcpy(val, value->data(), n);
+  val[n] = '\0';
+  return n < value->size() ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+  return ctx_of(r).query.size();
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+  auto &query = ctx_of(r).query;
+  if (query.empty())
+    return ESP_ERR_NOT_FOUND;
+  if (!buf_len)
+    return ESP_ERR_INVALID_ARG;
+  const size_t n = std::min(query.size(), buf_len - 1);
+  memcpy(buf, query.data(), n);
+  buf[n] = '\0';
+  return n < query.size() ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+  const size_t key_len = strlen(key);
+  for (const char *p = qry; p && *p;) {
+    const char *end = strchr(p, '&');
+    if (!end)
+      end = p + strlen(p);
+    if (0 == strncmp(p, key, key_len) && p[key_len] == '=') {
+      const char *v = p + key_len + 1;
+      const size_t v_len = end - v;
+      if (!val_size)
+        return ESP_ERR_INVALID_ARG;
+      const size_t n = std::min(v_len, val_size - 1);
+      memcpy(val, v, n);
+      val[n] = '\0';
+      return n < v_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+    }
+    p = *end ? end + 1 : end;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+  auto &ctx = ctx_of(r);
+  const size_t n = std::min(buf_len, ctx.body.size() - ctx.body_read);
+  memcpy(buf, ctx.body.data() + ctx.body_read, n);
+  ctx.body_read += n;
+  return n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+  return ctx_of(r).conn->fd;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+  auto frame = ctx_of(req).ws_frame;
+  if (!frame || !pkt)
+    return ESP_ERR_INVALID_ARG;
+  pkt->final = frame->final;
+  pkt->fragmented = frame->fragmented;
+  pkt->type = frame->type;
+  pkt->len = frame->len;
+  if (!max_len)
+    return ESP_OK;
+  if (!pkt->payload)
+    return ESP_ERR_INVALID_ARG;
+  pkt->len = std::min(frame->len, max_len);
+  memcpy(pkt->payload, frame->payload, pkt->len);
+  return pkt->len < frame->len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt) {
+  auto &ctx = ctx_of(req);
+  if (!ctx.conn->is_ws || !pkt || (pkt->len && !pkt->payload))
+    return ESP_ERR_INVALID_ARG;
+  HtsHostServer::ws_append_frame(ctx.conn->out.emplace_back(), pkt->type, (const char*) pkt->payload, pkt->len, pkt->final || !pkt->fragmented);
+  return ESP_OK;
+}
+
+///////// public interface ///////////////////
+httpd_handle_t hts_server;
+
+void ws_send_json(const char *json, ssize_t len) {
+  if (auto server = static_cast<HtsHostServer*>(hts_server))
+    server->ws_broadcast(json, len >= 0 ? len : strlen(json));
+}
+
+void sse_send_json(const char *json, ssize_t len) {
+  if (!*CONFIG_NET_HTTP_SERVER_SSE_URI)
+    return;
+  if (auto server = static_cast<HtsHostServer*>(hts_server))
+    server->sse_broadcast(json, len >= 0 ? len : strlen(json));
+}
+
+static esp_err_t handle_uri_sse(httpd_req_t *req) {
+  if (!check_access_allowed(req))
+    return ESP_OK;
+  server_of(req)->sse_attach(ctx_of(req));
+  return ESP_OK;
+}
+
+void sse_register_uri(httpd_handle_t server) {
+  if (!*CONFIG_NET_HTTP_SERVER_SSE_URI)
+    return;
+  httpd_uri_t sse_uri = { .uri = CONFIG_NET_HTTP_SERVER_SSE_URI, .method = HTTP_GET, .handler = handle_uri_sse, .user_ctx = NULL, .is_websocket = false };
+  httpd_register_uri_handler(server, &sse_uri);
+}
+
+bool hts_get_stats(struct hts_stats *stats) {
+  if (!hts_server)
+    return false;
+  static_cast<HtsHostServer*>(hts_server)->get_stats(stats);
+  return true;
+}
+
+void hts_enable_http_server(struct cfg_http *c) {
+  if (c && c->enable) {
+    if (hts_server)
+      return;
+    if (!auth_setup(c)) {
+      fprintf(stderr, logtag ": server start failed: invalid login data\n");
+      return;
+    }
+    auto server = new HtsHostServer(c->max_open_sockets, c->lru_purge);
+    sse_register_uri(server);
+    if (hts_register_uri_handlers_cb)
+      hts_register_uri_handlers_cb(server);
+    if (!server->start(CONFIG_NET_HTTP_SERVER_HOST_PORT)) {
+      fprintf(stderr, logtag ": server start failed\n");
+      delete server;
+      return;
+    }
+    hts_server = server;
+  } else {
+    if (hts_server) {
+      delete static_cast<HtsHostServer*>(hts_server);
+      hts_server = NULL;
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#include "net_http_server/http_server_setup.h"
+#include "net_http_server/content.hh"
+#include "net_http_server/host/http_server_host.h"
+#include "file_response.hh"
+#include "net_http_server/req_view.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONFIG_NET_HTTP_SERVER_DEBUG
+#define DEBUG
+#define D(x) x
+#else
+#define D(x)
+#endif
+
+/// \brief respond_file() on top of the host server's httpd API
+class HostFileResponder final: public HtsFileResponder {
+public:
+  explicit HostFileResponder(httpd_req_t *req) :
+      HtsFileResponder(m_read_buf, sizeof m_read_buf), m_req(req) {
+  }
+
+  bool set_status(const char *status) override {
+    return ESP_OK == httpd_resp_set_status(m_req, status);
+  }
+  bool set_type(const char *type) override {
+    return ESP_OK == httpd_resp_set_type(m_req, type);
+  }
+  bool set_hdr(const char *field, const char *value) override {
+    return ESP_OK == httpd_resp_set_hdr(m_req, field, value);
+  }
+  bool send(const char *buf, size_t len) override {
+    return ESP_OK == httpd_resp_send(m_req, buf, len);
+  }
+  bool send_chunk(const char *buf, size_t len) override {
+    return ESP_OK == httpd_resp_send_chunk(m_req, buf, len);
+  }
+
+private:
+  httpd_req_t *m_req;
+  char m_read_buf[4096];
+};
+
+/*
+ * \brief serve response data according to file_map matching the URI
+ */
+esp_err_t respond_file(httpd_req_t *req, const struct file_map *fm) {
+  HostFileResponder resp(req);
+  return hts_respondFile(resp, ReqView(req), fm, req->method == HTTP_HEAD) ? ESP_OK : ESP_FAIL;
+}
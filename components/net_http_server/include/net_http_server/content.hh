@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stddef.h>
 
 
 /**
@@ -23,6 +24,27 @@ public:
   virtual int open(const char *name, const char *query) = 0;
   virtual int read(int fd, char *buf, unsigned buf_size) = 0;
   virtual int close(int fd) = 0;
+  /**
+   * \brief         Set read position (needed to serve Range requests)
+   * \return        new position or -1 if not supported
+   */
+  virtual off_t seek(int fd, off_t offset) {
+    return -1;
+  }
+  /**
+   * \brief         Get size of content
+   * \return        size in bytes or -1 if unknown
+   */
+  virtual off_t size(int fd) {
+    return -1;
+  }
+  /**
+   * \brief         Get modification time of content (needed to cache content)
+   * \return        modification time or -1 if unknown
+   */
+  virtual time_t mtime(int fd) {
+    return -1;
+  }
 };
 
 /**
@@ -39,6 +61,21 @@ public:
   virtual int close(int fd) {
     return ::close(fd);
   }
+  virtual off_t seek(int fd, off_t offset) {
+    return ::lseek(fd, offset, SEEK_SET);
+  }
+  virtual off_t size(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+      return -1;
+    return st.st_size;
+  }
+  virtual time_t mtime(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+      return -1;
+    return st.st_mtime;
+  }
 private:
 };
 
@@ -49,6 +86,7 @@ struct web_content {
   const char *content; ///<  content data as byte array
   const char *content_encoding;  ///< NULL or, if \ref content is compressed, the value for HTTP header CONTENT_ENCODING e.g. "gzip", "br"
   unsigned content_length; ///< byte-length of content data
+  const char *etag; ///< NULL or quoted entity tag of content (e.g. "\"1a2b\""). Enables conditional requests (If-None-Match)
 };
 
 /**
@@ -69,6 +107,14 @@ struct file_map {
  */
 const struct file_map* wc_getContent(const char *uri);
 
+/**
+ * \brief  Table of files generated by tools/web_bundle.py (see tools/web_bundle.cmake).
+ *
+ *         The generated source also defines \ref wc_getContent using a perfect hash of the URIs.
+ */
+extern const struct file_map wc_bundled_files[];
+extern const unsigned wc_bundled_files_count; ///< number of elements in \ref wc_bundled_files
+
 extern const web_content wapp_html_gz_fm;
 extern const web_content wapp_js_gz_fm;
 extern const web_content wapp_js_map_gz_fm;
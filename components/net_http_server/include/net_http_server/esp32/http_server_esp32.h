@@ -28,16 +28,109 @@ bool check_access_allowed(struct httpd_req *req);
 */
 extern void (*hts_register_uri_handlers_cb)(httpd_handle_t server_handle);
 
+/**
+ * \brief                Register URI handler in the routing table of the server
+ *
+ *                       Routes are looked up in O(URI length) by a single wildcard handler per method,
+ *                       instead of matching each registered handler in turn.
+ *                       URIs may end with '*' to match all URIs starting with the part before.
+ *
+ * \note                 Handlers registered directly by httpd_register_uri_handler() take precedence,
+ *                       if registered within \ref hts_register_uri_handlers_cb. WebSocket handlers need to be registered that way.
+ * \param server_handle  The HTTP-server to register the URI handler
+ * \param uri_handler    URI handler (will be copied)
+ * \return               ESP_OK on success
+ */
+esp_err_t hts_register_route(httpd_handle_t server_handle, const httpd_uri_t *uri_handler);
+
 
 extern fd_set ws_fds;
 extern int ws_nfds;
 
+/**
+ * \brief      Serve response data according to file_map matching the URI
+ *
+ *             Supports HEAD and (if the content size is known and seekable) Range requests.
+ *             To serve HEAD requests, the URI handler has to be registered for HTTP_HEAD too.
+ */
 esp_err_t respond_file(httpd_req_t *req, const struct file_map *fm);
 void ws_async_broadcast(void *arg);
 esp_err_t ws_trigger_send(httpd_handle_t handle, const char *json, size_t len, int fd = -1);
+/**
+ * \brief       Send JSON event to all WebSocket clients
+ * \param json  JSON data
+ * \param len   length of JSON or -1 to use strlen(JSON)
+ */
 void ws_send_json(const char *json, ssize_t len);
+
+/**
+ * \brief       Send JSON event to all Server-Sent-Events clients (connected to NET_HTTP_SERVER_SSE_URI)
+ * \param json  JSON data
+ * \param len   length of JSON or -1 to use strlen(JSON)
+ */
+void sse_send_json(const char *json, ssize_t len);
+
+/**
+ * \brief               Send (a fragment of) a WebSocket text message in response to REQ
+ * \param req           WebSocket request
+ * \param s             data to send
+ * \param s_len         length of S or -1 to use strlen(S)
+ * \param chunk_status  0: unfragmented message. -1: first fragment. < -1: continuation fragment. > 0: final fragment (total number of fragments)
+ * \return              number of bytes sent or -1 on error
+ */
 int ws_write(void *req, const char *s, ssize_t s_len = -1, int chunk_status = -1);
 
+#ifdef CONFIG_APP_USE_WS
+/**
+ * \brief  Buffered writer for streaming a large WebSocket text message in constant memory
+ *
+ *         Output is collected in a buffer of frame size. Each time the buffer is full, it is sent as a
+ *         fragment using \ref ws_write.  The message ends by calling \ref finish (or by destruction).
+ *         If the message fits into a single buffer, it will be sent unfragmented.
+ */
+class WsStreamWriter {
+public:
+  /**
+   * \param req       WebSocket request to respond to
+   * \param buf_size  size of the frame buffer
+   */
+  WsStreamWriter(void *req, unsigned buf_size = CONFIG_NET_HTTP_SERVER_WS_FRAME_SIZE);
+  ~WsStreamWriter();
+  WsStreamWriter(const WsStreamWriter&) = delete;
+  WsStreamWriter& operator=(const WsStreamWriter&) = delete;
+
+public:
+  /**
+   * \brief        Append data to message
+   * \param s      data to append
+   * \param s_len  length of S or -1 to use strlen(S)
+   * \return       number of bytes appended or -1 on error
+   */
+  int write(const char *s, ssize_t s_len = -1);
+  /// \brief append single character C to message
+  int write(char c) {
+    return write(&c, 1);
+  }
+  /**
+   * \brief   Send remaining data as final fragment
+   * \return  true on success. false if this or any previous send has failed
+   */
+  bool finish();
+
+private:
+  bool send_fragment(bool final);
+
+private:
+  void *m_req;
+  char *m_buf;
+  unsigned m_buf_size;
+  unsigned m_buf_idx = 0;
+  int m_fragment_count = 0;
+  bool m_error = false;
+  bool m_finished = false;
+};
+#endif
+
 #ifdef __cplusplus
   }
 #endif
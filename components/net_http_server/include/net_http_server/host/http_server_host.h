@@ -0,0 +1,158 @@
+/**
+ * \file   net_http_server/host/http_server_host.h
+ * \brief  implementation specific interface for HTTP server on host (Linux)
+ *
+ *  Provides the subset of the esp_http_server API used by our URI handlers, so the same
+ *  handlers can be compiled and run on host.
+ */
+
+#ifdef __cplusplus
+  extern "C++" {
+#endif
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef ESP_OK
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_NOT_FOUND 0x105
+#endif
+#define ESP_ERR_HTTPD_BASE (0xb000)
+#define ESP_ERR_HTTPD_HANDLERS_FULL (ESP_ERR_HTTPD_BASE + 1)
+#define ESP_ERR_HTTPD_HANDLER_EXISTS (ESP_ERR_HTTPD_BASE + 2)
+#define ESP_ERR_HTTPD_INVALID_REQ (ESP_ERR_HTTPD_BASE + 3)
+#define ESP_ERR_HTTPD_RESULT_TRUNC (ESP_ERR_HTTPD_BASE + 4)
+#define ESP_ERR_HTTPD_RESP_HDR (ESP_ERR_HTTPD_BASE + 5)
+#define ESP_ERR_HTTPD_RESP_SEND (ESP_ERR_HTTPD_BASE + 6)
+
+#define HTTPD_RESP_USE_STRLEN -1
+
+typedef void *httpd_handle_t;
+
+/// \brief HTTP methods (same values as used by esp_http_server)
+typedef enum {
+  HTTP_DELETE = 0, HTTP_GET = 1, HTTP_HEAD = 2, HTTP_POST = 3, HTTP_PUT = 4, HTTP_OPTIONS = 6,
+} httpd_method_t;
+
+/// \brief error codes for \ref httpd_resp_send_err
+typedef enum {
+  HTTPD_400_BAD_REQUEST, HTTPD_401_UNAUTHORIZED, HTTPD_403_FORBIDDEN, HTTPD_404_NOT_FOUND, HTTPD_405_METHOD_NOT_ALLOWED,
+  HTTPD_408_REQ_TIMEOUT, HTTPD_411_LENGTH_REQUIRED, HTTPD_414_URI_TOO_LONG, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE,
+  HTTPD_500_INTERNAL_SERVER_ERROR, HTTPD_501_METHOD_NOT_IMPLEMENTED, HTTPD_505_VERSION_NOT_SUPPORTED,
+} httpd_err_code_t;
+
+/// \brief HTTP request passed to URI handlers
+typedef struct httpd_req {
+  httpd_handle_t handle; ///< server handle
+  int method;            ///< \ref httpd_method_t
+  const char *uri;       ///< null terminated request URI (including query string)
+  size_t content_len;    ///< length of request body
+  void *user_ctx;        ///< user context of the URI handler
+  void *aux;             ///< private data of the server implementation
+} httpd_req_t;
+
+/// \brief URI handler
+typedef struct httpd_uri {
+  const char *uri;  ///< URI. May end with '*' to match all URIs starting with the part before
+  httpd_method_t method;
+  esp_err_t (*handler)(httpd_req_t *r);
+  void *user_ctx;
+  bool is_websocket; ///< if true, GET requests to upgrade are accepted. The handler is called after the handshake (method HTTP_GET) and for each data frame (method 0)
+} httpd_uri_t;
+
+/// \brief WebSocket frame types (same values as the opcodes)
+typedef enum {
+  HTTPD_WS_TYPE_CONTINUE = 0x0, HTTPD_WS_TYPE_TEXT = 0x1, HTTPD_WS_TYPE_BINARY = 0x2, HTTPD_WS_TYPE_CLOSE = 0x8, HTTPD_WS_TYPE_PING = 0x9, HTTPD_WS_TYPE_PONG = 0xA,
+} httpd_ws_type_t;
+
+/// \brief WebSocket frame (control frames are handled by the server)
+typedef struct httpd_ws_frame {
+  bool final;           ///< FIN bit
+  bool fragmented;      ///< part of a fragmented message
+  httpd_ws_type_t type;
+  uint8_t *payload;
+  size_t len;
+} httpd_ws_frame_t;
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+/**
+ * \brief  Send complete response.  If BUF is NULL or for HEAD requests only the header is sent (BUF_LEN is still used for Content-Length)
+ */
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg);
+inline esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str) {
+  return httpd_resp_send(r, str, HTTPD_RESP_USE_STRLEN);
+}
+inline esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *r, const char *str) {
+  return httpd_resp_send_chunk(r, str, str ? HTTPD_RESP_USE_STRLEN : 0);
+}
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size);
+size_t httpd_req_get_url_query_len(httpd_req_t *r);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+int httpd_req_to_sockfd(httpd_req_t *r);
+/**
+ * \brief          Get the data frame the WebSocket handler is called for
+ * \param max_len  0 to get type and length only. Otherwise size of PKT->payload
+ */
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
+/// \brief queue frame on the connection of a WebSocket handler request
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt);
+
+extern httpd_handle_t hts_server; ///< Handle of the HTTP server if started. Or NULL if stopped.
+
+/**
+ * \brief      Test if a HTTP request is authenticated
+ * \param req  An incoming HTTP request to authenticate
+ * \return     true if authenticated, or if the server was created without authentication data
+ */
+bool check_access_allowed(struct httpd_req *req);
+
+/**
+* \brief                A callback in which the user registers his URI handlers
+* \param server_handle  The HTTP-server to register the URI handlers
+*/
+extern void (*hts_register_uri_handlers_cb)(httpd_handle_t server_handle);
+
+/**
+ * \brief                Register URI handler (same as httpd_register_uri_handler. Host server always routes by trie)
+ */
+inline esp_err_t hts_register_route(httpd_handle_t server_handle, const httpd_uri_t *uri_handler) {
+  return httpd_register_uri_handler(server_handle, uri_handler);
+}
+
+/**
+ * \brief      Serve response data according to file_map matching the URI
+ *
+ *             Supports HEAD and (if the content size is known and seekable) Range requests.
+ *             HEAD requests are routed to GET handlers if no HEAD handler was registered.
+ */
+esp_err_t respond_file(httpd_req_t *req, const struct file_map *fm);
+/**
+ * \brief       Send JSON event to all WebSocket clients
+ * \param json  JSON data
+ * \param len   length of JSON or -1 to use strlen(JSON)
+ */
+void ws_send_json(const char *json, ssize_t len);
+/**
+ * \brief       Send JSON event to all Server-Sent-Events clients (connected to NET_HTTP_SERVER_SSE_URI)
+ * \param json  JSON data
+ * \param len   length of JSON or -1 to use strlen(JSON)
+ */
+void sse_send_json(const char *json, ssize_t len);
+
+#ifdef __cplusplus
+  }
+#endif
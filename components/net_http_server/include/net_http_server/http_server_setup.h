@@ -21,13 +21,59 @@ struct cfg_http {
   char user[16] = CONFIG_APP_HTTP_USER;  ///< Auth user-name or empty string for no auth
   char password[31] = CONFIG_APP_HTTP_PASSWORD; ///< Auth password or empty string for no auth
   int8_t enable = CONFIG_APP_HTTP_ENABLE;  ///< If true, start server. If false, stop server.
+  uint32_t token_lifetime = CONFIG_NET_HTTP_SERVER_AUTH_TOKEN_LIFETIME; ///< Lifetime in seconds of session tokens issued after login, or 0 to disable tokens
+  uint8_t max_open_sockets = CONFIG_NET_HTTP_SERVER_MAX_OPEN_SOCKETS; ///< Maximal number of concurrent connections
+  uint16_t stack_size_extra = CONFIG_NET_HTTP_SERVER_STACK_SIZE_EXTRA; ///< Bytes added to the default stack size of the server task
+  bool lru_purge = CONFIG_NET_HTTP_SERVER_LRU_PURGE; ///< If all sockets are in use, close the least recently used connection to accept a new one
+};
+
+/// \brief HTTP server connection statistics
+struct hts_stats {
+  uint32_t accepted; ///< number of accepted connections since server start
+  uint32_t closed;   ///< number of closed connections since server start
+  uint16_t open;     ///< number of currently open connections
+  uint16_t open_peak; ///< maximal number of concurrently open connections since server start
+  uint16_t open_max; ///< configured limit of open connections
+};
+
+/**
+ * \brief        Get connection statistics
+ * \param stats  destination
+ * \return       false if server is not running
+ */
+bool hts_get_stats(struct hts_stats *stats);
+
+/// \brief statistics of the in-memory file cache
+struct hts_file_cache_stats {
+  uint32_t hits;       ///< requests served from cache
+  uint32_t misses;     ///< requests of cacheable files not found in cache (or outdated)
+  uint32_t evictions;  ///< entries removed to make room for others
+  uint32_t bytes_used; ///< current memory used by cached file data
+  uint16_t entries;    ///< current number of cached files
 };
 
+/**
+ * \brief        Get file cache statistics
+ * \param stats  destination
+ * \return       false if the cache is disabled
+ */
+bool hts_get_file_cache_stats(struct hts_file_cache_stats *stats);
+
 /**
  * \brief Start/stop HTTP server
  */
 void hts_setup(struct cfg_http *config);
 
+/**
+ * \brief        Stream output events to the Server-Sent-Events clients (see NET_HTTP_SERVER_SSE_URI)
+ *
+ *               Subscribes to the JSON format of the events selected by FLAGS and sends each as an event to
+ *               all clients connected to the SSE URI.
+ *
+ * \param flags  events to stream. The format flags are ignored. nullptr to stop streaming
+ */
+void hts_sse_uout_setup(const struct uo_flagsT *flags);
+
 #ifdef __cplusplus
   }
 #endif
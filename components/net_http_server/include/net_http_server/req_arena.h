@@ -0,0 +1,53 @@
+/**
+ * \file   net_http_server/req_arena.h
+ * \brief  Per-request memory for URI handlers
+ *
+ *  Memory is taken from a bump arena and released in one shot when the request is done. This avoids
+ *  heap fragmentation and large buffers on the server task stack.
+ *
+ *  The server releases the memory itself after the handler returns, so handlers don't need to. On ESP32 this
+ *  applies to handlers registered by hts_register_route(); handlers registered directly by
+ *  httpd_register_uri_handler() are not wrapped, so their memory is only released when the server task starts
+ *  matching the next request.
+ */
+
+#ifdef __cplusplus
+  extern "C++" {
+#endif
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+struct httpd_req;
+
+/**
+ * \brief       Allocate memory which lives until the request is done
+ * \param req   current request
+ * \param size  number of bytes
+ * \return      memory aligned for any type, or NULL if out of memory
+ */
+void *hts_req_alloc(struct httpd_req *req, size_t size);
+
+/// \brief copy LEN characters of S (null terminated) into request memory. \return copy or NULL
+char *hts_req_strndup(struct httpd_req *req, const char *s, size_t len);
+
+/// \brief printf into request memory (e.g. to build JSON). \return null terminated string or NULL
+char *hts_req_printf(struct httpd_req *req, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * \brief        Copy value of a request header into request memory
+ * \param field  header name (case insensitive)
+ * \return       null terminated value or NULL if header is missing
+ */
+char *hts_req_get_hdr(struct httpd_req *req, const char *field);
+
+/// \brief copy query string of request URI into request memory. \return query without '?' or NULL if none
+char *hts_req_get_query(struct httpd_req *req);
+
+/// \brief release all memory allocated for REQ
+void hts_req_free_all(struct httpd_req *req);
+
+#ifdef __cplusplus
+  }
+#endif
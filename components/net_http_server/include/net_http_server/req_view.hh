@@ -0,0 +1,86 @@
+/**
+ * \file   net_http_server/req_view.hh
+ * \brief  Access request path, query parameters and headers without copying
+ */
+#pragma once
+
+#include <stddef.h>
+#include <string_view>
+
+struct httpd_req;
+
+/**
+ * \brief  Parsed view of a HTTP request.
+ *
+ *         The URI is split into path and query parameters once, on construction. All returned views point into the
+ *         request itself (or into request memory, see req_arena.h) and are valid until the request is done.
+ */
+class ReqView {
+public:
+  static constexpr unsigned PARAMS_MAX = 16; ///< more query parameters are ignored
+  static constexpr unsigned HEADERS_CACHED = 4; ///< number of header values remembered by \ref header
+
+  explicit ReqView(struct httpd_req *req);
+
+  /// \brief URI path without query
+  std::string_view path() const {
+    return m_path;
+  }
+  /// \brief query string without '?'. Empty if none.  The data is null terminated (so it can be passed to C functions)
+  std::string_view query() const {
+    return m_query;
+  }
+  /// \brief number of query parameters
+  unsigned param_count() const {
+    return m_param_count;
+  }
+  /// \brief key of the Nth query parameter
+  std::string_view param_key(unsigned n) const {
+    return m_params[n].key;
+  }
+  /// \brief value of the Nth query parameter (still URL encoded)
+  std::string_view param_value(unsigned n) const {
+    return m_params[n].value;
+  }
+  /// \brief test if query has parameter KEY
+  bool has_param(std::string_view key) const {
+    return find_param(key) >= 0;
+  }
+  /// \brief value of query parameter KEY (still URL encoded) or empty if missing
+  std::string_view param(std::string_view key) const {
+    const int n = find_param(key);
+    return n < 0 ? std::string_view() : m_params[n].value;
+  }
+  /// \brief URL decoded value of query parameter KEY. Data is only copied (to request memory) if it contains escapes
+  std::string_view param_decoded(std::string_view key) const;
+
+  /**
+   * \brief        value of request header
+   *
+   *               On ESP32 the value is copied into request memory by the first call for NAME. The result is
+   *               remembered (for up to HEADERS_CACHED names), so later calls return it without copying again.
+   *
+   * \param name   header name (case insensitive). Must stay valid as long as this object (e.g. a string literal)
+   * \return       value or empty view if header is missing
+   */
+  std::string_view header(const char *name) const;
+
+private:
+  void parse(const char *uri);
+  int find_param(std::string_view key) const;
+
+private:
+  struct param_t {
+    std::string_view key, value;
+  };
+  struct httpd_req *m_req;
+  std::string_view m_path, m_query;
+  param_t m_params[PARAMS_MAX];
+  unsigned m_param_count = 0;
+  struct header_t {
+    const char *name;
+    std::string_view value;
+  };
+  mutable header_t m_headers[HEADERS_CACHED];
+  mutable unsigned m_header_count = 0;
+};
@@ -0,0 +1,123 @@
+/**
+ * \file    net_http_server/uri_trie.hh
+ * \brief   Map URIs to values using a character trie.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \brief  Look up values by URI in O(URI length)
+ *
+ *         URIs ending with '*' match any URI starting with the part before the '*'.
+ *         If more than one URI matches, exact matches win over wildcard matches and longer wildcard matches
+ *         win over shorter ones.  A query string (starting with '?') is ignored on look up.
+ *
+ * \tparam value_type   type of values to store
+ */
+template<typename value_type>
+class UriTrie {
+  struct Node {
+    char ch;
+    int16_t first_child = -1;
+    int16_t next_sibling = -1;
+    int16_t value_idx = -1;    ///< value for exact match
+    int16_t wildcard_idx = -1; ///< value for URIs starting with the path to this node
+  };
+
+public:
+  /**
+   * \brief        Add a URI
+   * \param uri    null terminated URI, optionally ending with '*'
+   * \param value  value to store for URI
+   * \return       false if URI was already added or the trie is full
+   */
+  bool add(const char *uri, const value_type &value) {
+    if (m_nodes.empty())
+      m_nodes.push_back(Node { '\0' });
+
+    int node = 0;
+    bool wildcard = false;
+    for (const char *p = uri; *p; ++p) {
+      if (*p == '*' && p[1] == '\0') {
+        wildcard = true;
+        break;
+      }
+      node = get_child(node, *p, true);
+      if (node < 0)
+        return false;
+    }
+
+    int16_t &idx = wildcard ? m_nodes[node].wildcard_idx : m_nodes[node].value_idx;
+    if (idx >= 0 || m_values.size() >= INT16_MAX)
+      return false;
+    idx = m_values.size();
+    m_values.push_back(value);
+    return true;
+  }
+
+  /**
+   * \brief          Find value for URI
+   * \param uri      URI (not necessarily null terminated)
+   * \param uri_len  length of URI
+   * \return         pointer to value or nullptr if no URI matches
+   */
+  const value_type* find(const char *uri, size_t uri_len) const {
+    if (m_nodes.empty())
+      return nullptr;
+
+    int best = -1;
+    int node = 0;
+    for (size_t i = 0; i < uri_len && uri[i] != '?'; ++i) {
+      if (m_nodes[node].wildcard_idx >= 0)
+        best = m_nodes[node].wildcard_idx;
+      if ((node = get_child(node, uri[i])) < 0)
+        return best >= 0 ? &m_values[best] : nullptr;
+    }
+
+    if (m_nodes[node].value_idx >= 0)
+      best = m_nodes[node].value_idx;
+    else if (m_nodes[node].wildcard_idx >= 0)
+      best = m_nodes[node].wildcard_idx;
+    return best >= 0 ? &m_values[best] : nullptr;
+  }
+
+  /// \brief remove all URIs
+  void clear() {
+    m_nodes.clear();
+    m_values.clear();
+  }
+
+  /// \brief test if no URI was added
+  bool empty() const {
+    return m_values.empty();
+  }
+
+private:
+  int get_child(int node, char ch) const {
+    for (int child = m_nodes[node].first_child; child >= 0; child = m_nodes[child].next_sibling) {
+      if (m_nodes[child].ch == ch)
+        return child;
+    }
+    return -1;
+  }
+
+  int get_child(int node, char ch, bool create) {
+    if (int child = get_child(node, ch); child >= 0 || !create)
+      return child;
+    if (m_nodes.size() >= INT16_MAX)
+      return -1;
+
+    const int16_t child = m_nodes.size();
+    m_nodes.push_back(Node { ch });
+    m_nodes[child].next_sibling = m_nodes[node].first_child;
+    m_nodes[node].first_child = child;
+    return child;
+  }
+
+private:
+  std::vector<Node> m_nodes;
+  std::vector<value_type> m_values;
+};
@@ -0,0 +1,80 @@
+#include "auth_token.hh"
+
+#include <mbedtls/md.h>
+#include <string.h>
+#include <stdio.h>
+
+#define MAC_LEN 16 ///< truncated length of HMAC-SHA256
+
+static uint8_t Key[32];
+static size_t Key_len;
+
+static bool compute_mac(const char *expires_hex, uint8_t mac[MAC_LEN]) {
+  uint8_t md[32];
+  const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+  if (!md_info || !Key_len)
+    return false;
+  if (0 != mbedtls_md_hmac(md_info, Key, Key_len, (const unsigned char*) expires_hex, 8, md))
+    return false;
+  memcpy(mac, md, MAC_LEN);
+  return true;
+}
+
+static int hex_digit(char c) {
+  if ('0' <= c && c <= '9')
+    return c - '0';
+  if ('a' <= c && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+void authToken_setKey(const uint8_t *key, size_t key_len) {
+  Key_len = key_len < sizeof Key ? key_len : sizeof Key;
+  memcpy(Key, key, Key_len);
+}
+
+bool authToken_create(char *dst, size_t dst_size, uint32_t expires) {
+  if (dst_size <= AUTH_TOKEN_LEN)
+    return false;
+
+  snprintf(dst, dst_size, "%08lx.", (unsigned long) expires);
+
+  uint8_t mac[MAC_LEN];
+  if (!compute_mac(dst, mac))
+    return false;
+
+  char *p = dst + 9;
+  for (auto b : mac) {
+    *p++ = "0123456789abcdef"[b >> 4];
+    *p++ = "0123456789abcdef"[b & 0x0f];
+  }
+  *p = '\0';
+  return true;
+}
+
+bool authToken_verify(const char *token, size_t token_len, uint32_t now) {
+  if (token_len != AUTH_TOKEN_LEN || token[8] != '.')
+    return false;
+
+  uint32_t expires = 0;
+  for (int i = 0; i < 8; ++i) {
+    const int d = hex_digit(token[i]);
+    if (d < 0)
+      return false;
+    expires = (expires << 4) | d;
+  }
+  if (expires <= now)
+    return false;
+
+  uint8_t mac[MAC_LEN];
+  if (!compute_mac(token, mac))
+    return false;
+
+  // compare in constant time
+  uint8_t diff = 0;
+  for (int i = 0; i < MAC_LEN; ++i) {
+    const int hi = hex_digit(token[9 + i * 2]), lo = hex_digit(token[9 + i * 2 + 1]);
+    diff |= (hi | lo) < 0 ? 0xff : mac[i] ^ ((hi << 4) | lo);
+  }
+  return diff == 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * \file   auth_token.hh
+ * \brief  HMAC signed, expiring session tokens
+ *
+ *  Token format: "EEEEEEEE.MMMM...": expiry time (seconds, 8 hex digits),
+ *  followed by the truncated HMAC-SHA256 of the expiry time (32 hex digits)
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+constexpr unsigned AUTH_TOKEN_LEN = 8 + 1 + 32; ///< length of a token string (without null terminator)
+#define AUTH_TOKEN_COOKIE "hts_token"  ///< name of the cookie holding the token
+
+/**
+ * \brief          Set secret key for signing tokens. Tokens signed with a previous key become invalid.
+ * \param key      secret key data (should be random)
+ * \param key_len  length of KEY (up to 32 bytes are used)
+ */
+void authToken_setKey(const uint8_t *key, size_t key_len);
+
+/**
+ * \brief           Create a token
+ * \param dst       buffer to receive the null terminated token
+ * \param dst_size  size of DST. Must be greater than AUTH_TOKEN_LEN
+ * \param expires   time in seconds when the token will expire
+ * \return          true for success
+ */
+bool authToken_create(char *dst, size_t dst_size, uint32_t expires);
+
+/**
+ * \brief            Verify a token
+ * \param token      token string (must not be null terminated)
+ * \param token_len  length of TOKEN
+ * \param now        current time in seconds (same time base as used for creation)
+ * \return           true if the token has a valid signature and is not expired
+ */
+bool authToken_verify(const char *token, size_t token_len, uint32_t now);
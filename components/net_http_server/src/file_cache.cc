@@ -0,0 +1,109 @@
+#include "file_cache.hh"
+#include "net_http_server/http_server_setup.h"
+
+#include <list>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONFIG_NET_HTTP_SERVER_DEBUG
+#define DEBUG
+#define D(x) x
+#else
+#define D(x)
+#endif
+
+struct cache_entry {
+  std::string path;
+  off_t size;
+  time_t mtime;
+  std::shared_ptr<const std::string> data;
+};
+
+static std::mutex Cache_mutex;
+static std::list<cache_entry> Entries; ///< most recently used first
+static size_t Bytes_used;
+static hts_file_cache_stats Stats;
+
+static void erase_entry(std::list<cache_entry>::iterator it) {
+  Bytes_used -= it->size;
+  Entries.erase(it);
+}
+
+static std::shared_ptr<const std::string> read_all(ContentReader &reader, int fd, off_t size) {
+  auto data = std::make_shared<std::string>(size, '\0');
+  for (off_t pos = 0; pos < size;) {
+    const int n = reader.read(fd, &(*data)[pos], size - pos);
+    if (n <= 0)
+      return nullptr;
+    pos += n;
+  }
+  // make sure the file did not grow since we got its size
+  char c;
+  if (reader.read(fd, &c, 1) != 0)
+    return nullptr;
+  return data;
+}
+
+std::shared_ptr<const std::string> fileCache_get(const char *path, ContentReader &reader, int fd) {
+  if (CONFIG_NET_HTTP_SERVER_FILE_CACHE_SIZE == 0)
+    return nullptr;
+
+  const off_t size = reader.size(fd);
+  if (size < 0 || size > CONFIG_NET_HTTP_SERVER_FILE_CACHE_MAX_FILE_SIZE || size > CONFIG_NET_HTTP_SERVER_FILE_CACHE_SIZE)
+    return nullptr;
+  const time_t mtime = reader.mtime(fd);
+  if (mtime == (time_t) -1)
+    return nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(Cache_mutex);
+    for (auto it = Entries.begin(); it != Entries.end(); ++it) {
+      if (it->path != path)
+        continue;
+      if (it->size == size && it->mtime == mtime) {
+        ++Stats.hits;
+        Entries.splice(Entries.begin(), Entries, it);
+        return it->data;
+      }
+      erase_entry(it); // outdated
+      break;
+    }
+    ++Stats.misses;
+  }
+
+  // read file without holding the lock
+  auto data = read_all(reader, fd, size);
+  if (!data || reader.seek(fd, 0) != 0)
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(Cache_mutex);
+  for (auto it = Entries.begin(); it != Entries.end(); ++it) {
+    if (it->path == path) {
+      erase_entry(it); // inserted concurrently
+      break;
+    }
+  }
+  while (!Entries.empty() && Bytes_used + size > CONFIG_NET_HTTP_SERVER_FILE_CACHE_SIZE) {
+    D(fprintf(stderr, "file_cache: evict <%s>\n", Entries.back().path.c_str()));
+    ++Stats.evictions;
+    erase_entry(std::prev(Entries.end()));
+  }
+  Entries.push_front(cache_entry { path, size, mtime, data });
+  Bytes_used += size;
+  return data;
+}
+
+void fileCache_clear() {
+  std::lock_guard<std::mutex> lock(Cache_mutex);
+  Entries.clear();
+  Bytes_used = 0;
+}
+
+bool hts_get_file_cache_stats(struct hts_file_cache_stats *stats) {
+  std::lock_guard<std::mutex> lock(Cache_mutex);
+  *stats = Stats;
+  stats->entries = Entries.size();
+  stats->bytes_used = Bytes_used;
+  return CONFIG_NET_HTTP_SERVER_FILE_CACHE_SIZE > 0;
+}
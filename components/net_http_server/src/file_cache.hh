@@ -0,0 +1,26 @@
+/**
+ * \file   file_cache.hh
+ * \brief  LRU cache of small files served by a ContentReader
+ */
+#pragma once
+
+#include "net_http_server/content.hh"
+
+#include <memory>
+#include <string>
+
+/**
+ * \brief         Get content of an open file from cache. Load it into the cache if missing or outdated.
+ *
+ *                Entries are keyed by path, size and modification time. Files larger than
+ *                CONFIG_NET_HTTP_SERVER_FILE_CACHE_MAX_FILE_SIZE or readers without \ref ContentReader::mtime are not cached.
+ *
+ * \param path    file name used to open FD
+ * \param reader  reader used to open FD
+ * \param fd      open file at read position 0
+ * \return        file content or nullptr if not cacheable.  Remains valid even if evicted meanwhile
+ */
+std::shared_ptr<const std::string> fileCache_get(const char *path, ContentReader &reader, int fd);
+
+/// \brief remove all entries from cache
+void fileCache_clear();
@@ -0,0 +1,201 @@
+#include "file_response.hh"
+#include "http_range.hh"
+#include "file_cache.hh"
+#include "net_http_server/content.hh"
+#include "net_http_server/req_view.hh"
+#include "net_http_server/http_server_setup.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONFIG_NET_HTTP_SERVER_DEBUG
+#define DEBUG
+#define D(x) x
+#else
+#define D(x)
+#endif
+#define logtag "http_server"
+
+#define RANGES_MAX 8 ///< more ranges in a request will make us ignore the Range header
+
+/**
+ * \brief content data of a file_map. Either from memory, from file cache or opened by its content_reader
+ */
+struct content_source {
+  content_source(const ReqView &rv, const struct file_map *fm) :
+      m_fm(fm) {
+    if (fm->content_reader) {
+      const char *query = rv.query().empty() ? nullptr : rv.query().data();
+      fd = fm->content_reader->open(fm->wc.content, query);
+      if (fd >= 0 && !query && (m_cached = fileCache_get(fm->wc.content, *fm->content_reader, fd))) {
+        fm->content_reader->close(fd);
+        fd = -1;
+        mem = m_cached->data();
+        size = m_cached->size();
+        seekable = true;
+      } else if (fd >= 0) {
+        size = fm->content_reader->size(fd);
+        seekable = size >= 0 && fm->content_reader->seek(fd, 0) == 0;
+      }
+    } else if (fm->wc.content) {
+      mem = fm->wc.content;
+      size = fm->wc.content_length ? fm->wc.content_length : strlen(fm->wc.content);
+      seekable = true;
+    }
+  }
+  ~content_source() {
+    if (fd >= 0)
+      m_fm->content_reader->close(fd);
+  }
+  bool is_valid() const {
+    return mem || fd >= 0;
+  }
+
+  /**
+   * \brief         send part of the content as response chunk(s). Does not send the terminating empty chunk.
+   * \param offset  start of data
+   * \param len     length of data or -1 to send everything from the current position up to the end
+   */
+  bool send_chunks(HtsFileResponder &resp, off_t offset, off_t len) {
+    if (mem)
+      return resp.send_chunk(mem + offset, len < 0 ? size - offset : len);
+
+    if (len >= 0 && m_fm->content_reader->seek(fd, offset) != offset)
+      return false;
+
+    while (len) {
+      const unsigned want = (len > 0 && len < (off_t) resp.m_buf_size) ? len : resp.m_buf_size;
+      const int bytes_read = m_fm->content_reader->read(fd, resp.m_buf, want);
+
+      if (bytes_read < 0) {
+        D(fprintf(stderr, logtag ": respond_file: read error\n"));
+        return false;
+      }
+      if (bytes_read == 0)
+        return len < 0; // file shrunk?
+
+      if (!resp.send_chunk(resp.m_buf, bytes_read))
+        return false;
+      if (len > 0)
+        len -= bytes_read;
+    }
+    return true;
+  }
+
+  /// \brief get size of content with unknown size by reading it. \return size or -1 on error
+  off_t measure(HtsFileResponder &resp) {
+    off_t total = 0;
+    for (int bytes_read; (bytes_read = m_fm->content_reader->read(fd, resp.m_buf, resp.m_buf_size));) {
+      if (bytes_read < 0)
+        return -1;
+      total += bytes_read;
+    }
+    return total;
+  }
+
+  const struct file_map *m_fm;
+  std::shared_ptr<const std::string> m_cached;
+  const char *mem = nullptr; ///< content in memory (static or cached) or NULL
+  int fd = -1;
+  off_t size = -1; ///< size of content or -1 if unknown
+  bool seekable = false; ///< true if we can serve Range requests
+};
+
+bool hts_respondFile(HtsFileResponder &resp, const ReqView &rv, const struct file_map *fm, bool head) {
+
+  auto set_hdrs = [&resp, fm]() -> bool {
+    if (fm->type && !resp.set_type(fm->type))
+      return false;
+    if (fm->wc.content_encoding && !resp.set_hdr("content-encoding", fm->wc.content_encoding))
+      return false;
+    return true;
+  };
+
+  // conditional request: client has still the current version
+  if (fm->wc.etag) {
+    const std::string_view if_none_match = rv.header("If-None-Match");
+    if (!if_none_match.empty() && http_etagMatch(if_none_match.data(), if_none_match.size(), fm->wc.etag))
+      return resp.set_status("304 Not Modified") && resp.set_hdr("ETag", fm->wc.etag) && resp.send(nullptr, 0);
+    if (!resp.set_hdr("ETag", fm->wc.etag))
+      return false;
+  }
+
+  content_source src(rv, fm);
+  if (!src.is_valid())
+    return false;
+
+  // like GET, but only the header. Content-Length must be the same as for GET
+  if (head) {
+    if (src.size < 0 && (src.size = src.measure(resp)) < 0)
+      return false;
+    if (src.seekable && !resp.set_hdr("Accept-Ranges", "bytes"))
+      return false;
+    return set_hdrs() && resp.send(nullptr, src.size);
+  }
+
+  if (src.seekable && !resp.set_hdr("Accept-Ranges", "bytes"))
+    return false;
+
+  http_range ranges[RANGES_MAX];
+  int n_ranges = 0;
+  if (src.seekable) {
+    // a multipart body of compressed parts would be useless to the client. So allow only a single range then.
+    if (const std::string_view range_hdr = rv.header("Range"); !range_hdr.empty())
+      n_ranges = http_parseRange(range_hdr.data(), range_hdr.size(), src.size, ranges, fm->wc.content_encoding ? 1 : RANGES_MAX);
+  }
+
+  char content_range[48];
+
+  // no satisfiable range
+  if (n_ranges < 0) {
+    snprintf(content_range, sizeof content_range, "bytes */%lld", (long long) src.size);
+    return resp.set_status("416 Range Not Satisfiable") && resp.set_hdr("Content-Range", content_range) && resp.send(nullptr, 0);
+  }
+
+  if (!set_hdrs())
+    return false;
+
+  // serve whole content
+  if (n_ranges == 0) {
+    if (src.mem)
+      return resp.send(src.mem, src.size);
+
+    // send chunks. last chunk needs to have size zero
+    return src.send_chunks(resp, 0, -1) && resp.send_chunk(nullptr, 0);
+  }
+
+  if (!resp.set_status("206 Partial Content"))
+    return false;
+
+  // serve single range
+  if (n_ranges == 1) {
+    const http_range &r = ranges[0];
+    snprintf(content_range, sizeof content_range, "bytes %llu-%llu/%lld", (unsigned long long) r.first, (unsigned long long) r.last, (long long) src.size);
+    if (!resp.set_hdr("Content-Range", content_range))
+      return false;
+
+    if (src.mem)
+      return resp.send(src.mem + r.first, r.last - r.first + 1);
+
+    return src.send_chunks(resp, r.first, r.last - r.first + 1) && resp.send_chunk(nullptr, 0);
+  }
+
+  // serve multiple ranges as multipart/byteranges
+  if (!resp.set_type("multipart/byteranges; boundary=" HTTP_MULTIPART_BOUNDARY))
+    return false;
+
+  for (int i = 0; i < n_ranges; ++i) {
+    const http_range &r = ranges[i];
+    char part_hdr[192];
+    const int n = snprintf(part_hdr, sizeof part_hdr, "\r\n--" HTTP_MULTIPART_BOUNDARY "\r\nContent-Type: %s\r\nContent-Range: bytes %llu-%llu/%lld\r\n\r\n",
+        fm->type ? fm->type : "application/octet-stream", (unsigned long long) r.first, (unsigned long long) r.last, (long long) src.size);
+    if (n >= (int) sizeof part_hdr)
+      return false;
+
+    if (!(resp.send_chunk(part_hdr, n) && src.send_chunks(resp, r.first, r.last - r.first + 1)))
+      return false;
+  }
+
+  static const char closing[] = "\r\n--" HTTP_MULTIPART_BOUNDARY "--\r\n";
+  return resp.send_chunk(closing, sizeof closing - 1) && resp.send_chunk(nullptr, 0);
+}
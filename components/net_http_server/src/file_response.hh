@@ -0,0 +1,49 @@
+/**
+ * \file   file_response.hh
+ * \brief  Platform independent part of respond_file()
+ */
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+struct file_map;
+class ReqView;
+
+/**
+ * \brief  Response functions used by \ref hts_respondFile, implemented for each platform on top of its httpd API
+ *
+ *         All functions return false on error.
+ */
+class HtsFileResponder {
+public:
+  /**
+   * \param buf       buffer for reading from a ContentReader
+   * \param buf_size  size of BUF
+   */
+  HtsFileResponder(char *buf, unsigned buf_size) :
+      m_buf(buf), m_buf_size(buf_size) {
+  }
+  virtual ~HtsFileResponder() = default;
+
+  virtual bool set_status(const char *status) = 0;
+  virtual bool set_type(const char *type) = 0;
+  virtual bool set_hdr(const char *field, const char *value) = 0;
+  /// \brief send complete response with Content-Length LEN. If BUF is NULL only the header is sent (response to HEAD)
+  virtual bool send(const char *buf, size_t len) = 0;
+  /// \brief send a chunk of a chunked response. LEN 0 terminates the response
+  virtual bool send_chunk(const char *buf, size_t len) = 0;
+
+public:
+  char *const m_buf;
+  const unsigned m_buf_size;
+};
+
+/**
+ * \brief       Serve content of FM with support for conditional (ETag), HEAD and Range requests
+ * \param resp  platform response functions
+ * \param rv    the request
+ * \param head  true for a HEAD request
+ * \return      false on error
+ */
+bool hts_respondFile(HtsFileResponder &resp, const ReqView &rv, const struct file_map *fm, bool head);
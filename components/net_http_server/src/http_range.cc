@@ -0,0 +1,96 @@
+#include "http_range.hh"
+
+#include <string.h>
+
+static bool parse_number(const char *&p, const char *end, uint64_t &result) {
+  const char *start = p;
+  uint64_t n = 0;
+  for (; p < end && '0' <= *p && *p <= '9'; ++p) {
+    if (n > (UINT64_MAX - 9) / 10)
+      return false;
+    n = n * 10 + (*p - '0');
+  }
+  result = n;
+  return p != start;
+}
+
+int http_parseRange(const char *hdr, size_t hdr_len, uint64_t size, http_range *ranges, int ranges_max) {
+  const char *p = hdr, *end = hdr + hdr_len;
+  if (hdr_len < 6 || 0 != strncmp(p, "bytes=", 6))
+    return 0;
+  p += 6;
+
+  int count = 0;
+  bool any_range = false;
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+      ++p;
+
+    uint64_t first = 0, last = size ? size - 1 : 0;
+    bool satisfiable = true;
+    if (p < end && *p == '-') {
+      // suffix range: the last N bytes
+      uint64_t suffix_len;
+      ++p;
+      if (!parse_number(p, end, suffix_len))
+        return 0;
+      if (suffix_len == 0 || size == 0)
+        satisfiable = false;
+      else if (suffix_len < size)
+        first = size - suffix_len;
+    } else {
+      if (!parse_number(p, end, first) || p >= end || *p++ != '-')
+        return 0;
+      uint64_t n;
+      if (parse_number(p, end, n)) {
+        if (n < first)
+          return 0;
+        if (n < last)
+          last = n;
+      }
+      if (first >= size)
+        satisfiable = false;
+    }
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+      ++p;
+    if (p < end && *p++ != ',')
+      return 0;
+
+    any_range = true;
+    if (!satisfiable)
+      continue;
+    if (count == ranges_max)
+      return 0;
+    ranges[count++] = http_range { first, last };
+  }
+
+  if (!any_range)
+    return 0;
+  return count ? count : -1;
+}
+
+bool http_etagMatch(const char *hdr, size_t hdr_len, const char *etag) {
+  const size_t etag_len = strlen(etag);
+  const char *hdr_end = hdr + hdr_len;
+  for (const char *p = hdr; p < hdr_end;) {
+    while (p < hdr_end && (*p == ' ' || *p == '\t' || *p == ','))
+      ++p;
+    if (p == hdr_end)
+      break;
+    if (*p == '*')
+      return true;
+    if (hdr_end - p >= 2 && p[0] == 'W' && p[1] == '/')
+      p += 2;
+    const char *end = static_cast<const char*>(memchr(p, ',', hdr_end - p));
+    size_t len = (end ? end : hdr_end) - p;
+    while (len && (p[len - 1] == ' ' || p[len - 1] == '\t'))
+      --len;
+    if (len == etag_len && 0 == strncmp(p, etag, len))
+      return true;
+    if (!end)
+      break;
+    p = end;
+  }
+  return false;
+}
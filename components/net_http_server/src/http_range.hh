@@ -0,0 +1,38 @@
+/**
+ * \file   http_range.hh
+ * \brief  Parse HTTP Range and conditional request headers
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_MULTIPART_BOUNDARY "HTS_BYTERANGES_5f3a9c" ///< boundary used for multipart/byteranges responses
+
+/// \brief byte range (both offsets inclusive)
+struct http_range {
+  uint64_t first;
+  uint64_t last;
+};
+
+/**
+ * \brief              Parse value of HTTP Range header
+ * \param hdr          header value (e.g. "bytes=0-99,200-")
+ * \param hdr_len      length of HDR
+ * \param size         size of the content in bytes
+ * \param[out] ranges  satisfiable ranges (clamped to SIZE)
+ * \param ranges_max   capacity of RANGES
+ * \return             number of ranges stored in RANGES.
+ *                     0 if the header should be ignored (syntax error, unknown unit or too many ranges).
+ *                     -1 if no range is satisfiable
+ */
+int http_parseRange(const char *hdr, size_t hdr_len, uint64_t size, http_range *ranges, int ranges_max);
+
+/**
+ * \brief                Test if the value of If-None-Match header matches an entity tag (weak comparison)
+ * \param hdr            value of If-None-Match header (e.g. "\"a1\", W/\"b2\"" or "*")
+ * \param hdr_len        length of HDR
+ * \param etag           null terminated quoted entity tag of current content
+ * \return               true if matched (the response should be 304 Not Modified)
+ */
+bool http_etagMatch(const char *hdr, size_t hdr_len, const char *etag);
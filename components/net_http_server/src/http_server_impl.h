@@ -1,6 +1,10 @@
 #pragma once
 #include <net_http_server/http_server_setup.h>
+#include <sys/types.h>
 
 
 void hts_enable_http_server(struct cfg_http *config);
 
+void sse_register_uri(void *server_handle);
+void sse_forget(int sockfd);
+void sse_send_json(const char *json, ssize_t len);
@@ -0,0 +1,88 @@
+#include "req_arena.hh"
+#include "net_http_server/req_arena.h"
+#include "net_http_server/http_server_setup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+ReqArena::~ReqArena() {
+  reset();
+  free(m_head);
+}
+
+ReqArena::block* ReqArena::new_block(size_t data_size) {
+  auto b = static_cast<block*>(malloc(header_size() + data_size));
+  if (b)
+    *b = block { nullptr, data_size, 0 };
+  return b;
+}
+
+void* ReqArena::alloc(size_t size) {
+  size = (size + Align - 1) & ~(Align - 1);
+
+  if (!m_head && !(m_head = new_block(m_block_size)))
+    return nullptr;
+
+  if (m_head->size - m_head->used < size) {
+    block *b = new_block(size > m_block_size ? size : m_block_size);
+    if (!b)
+      return nullptr;
+    b->next = m_head;
+    m_head = b;
+  }
+
+  void *result = data(m_head) + m_head->used;
+  m_head->used += size;
+  return result;
+}
+
+void ReqArena::reset() {
+  if (!m_head)
+    return;
+  while (m_head->next) {
+    block *next = m_head->next;
+    free(m_head);
+    m_head = next;
+  }
+  m_head->used = 0;
+}
+
+size_t ReqArena::used() const {
+  size_t result = 0;
+  for (block *b = m_head; b; b = b->next)
+    result += b->used;
+  return result;
+}
+
+/////////////////////public API/////////////////////
+
+void *hts_req_alloc(struct httpd_req *req, size_t size) {
+  return hts_req_arena(req).alloc(size);
+}
+
+char *hts_req_strndup(struct httpd_req *req, const char *s, size_t len) {
+  auto result = static_cast<char*>(hts_req_arena(req).alloc(len + 1));
+  if (result) {
+    memcpy(result, s, len);
+    result[len] = '\0';
+  }
+  return result;
+}
+
+char *hts_req_printf(struct httpd_req *req, const char *fmt, ...) {
+  va_list args, args2;
+  va_start(args, fmt);
+  va_copy(args2, args);
+  char *result = nullptr;
+  const int len = vsnprintf(nullptr, 0, fmt, args);
+  if (len >= 0 && (result = static_cast<char*>(hts_req_arena(req).alloc(len + 1))))
+    vsnprintf(result, len + 1, fmt, args2);
+  va_end(args2);
+  va_end(args);
+  return result;
+}
+
+void hts_req_free_all(struct httpd_req *req) {
+  hts_req_arena(req).reset();
+}
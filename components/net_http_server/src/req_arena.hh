@@ -0,0 +1,54 @@
+/**
+ * \file   req_arena.hh
+ * \brief  Bump allocator released in one shot
+ */
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * \brief  Bump allocator
+ *
+ *         Allocates from a block which is kept between resets. If the block is exhausted, additional
+ *         blocks are taken from the heap and freed again by \ref reset.
+ */
+class ReqArena {
+  struct block {
+    block *next;
+    size_t size;
+    size_t used;
+  };
+  static constexpr size_t Align = alignof(max_align_t);
+
+public:
+  explicit ReqArena(size_t block_size) :
+      m_block_size(block_size) {
+  }
+  ~ReqArena();
+  ReqArena(const ReqArena&) = delete;
+  ReqArena& operator=(const ReqArena&) = delete;
+
+  /// \brief allocate SIZE bytes (aligned for any type) or return nullptr if out of memory
+  void* alloc(size_t size);
+  /// \brief release all allocations. The first block is kept for reuse
+  void reset();
+  /// \brief bytes currently allocated
+  size_t used() const;
+
+private:
+  static block* new_block(size_t data_size);
+  static char* data(block *b) {
+    return reinterpret_cast<char*>(b) + header_size();
+  }
+  static constexpr size_t header_size() {
+    return (sizeof(block) + Align - 1) & ~(Align - 1);
+  }
+
+private:
+  block *m_head = nullptr; ///< current block. The last one in the list is the kept one
+  size_t m_block_size;
+};
+
+struct httpd_req;
+/// \brief arena of the server handling REQ (implemented by each platform)
+ReqArena& hts_req_arena(struct httpd_req *req);
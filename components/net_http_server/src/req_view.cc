@@ -0,0 +1,67 @@
+#include "net_http_server/req_view.hh"
+#include "net_http_server/req_arena.h"
+
+#include <string.h>
+
+void ReqView::parse(const char *uri) {
+  const char *q = strchr(uri, '?');
+  if (!q) {
+    m_path = std::string_view(uri);
+    return;
+  }
+  m_path = std::string_view(uri, q - uri);
+  m_query = std::string_view(q + 1);
+
+  for (std::string_view rest = m_query; !rest.empty() && m_param_count < PARAMS_MAX;) {
+    const size_t amp = rest.find('&');
+    const std::string_view kv = rest.substr(0, amp);
+    rest = amp == std::string_view::npos ? std::string_view() : rest.substr(amp + 1);
+    if (kv.empty())
+      continue;
+
+    const size_t eq = kv.find('=');
+    auto &param = m_params[m_param_count++];
+    param.key = kv.substr(0, eq);
+    param.value = eq == std::string_view::npos ? std::string_view() : kv.substr(eq + 1);
+  }
+}
+
+int ReqView::find_param(std::string_view key) const {
+  for (unsigned i = 0; i < m_param_count; ++i) {
+    if (m_params[i].key == key)
+      return i;
+  }
+  return -1;
+}
+
+static int hex_value(char c) {
+  if ('0' <= c && c <= '9')
+    return c - '0';
+  if ('a' <= (c | 0x20) && (c | 0x20) <= 'f')
+    return (c | 0x20) - 'a' + 10;
+  return -1;
+}
+
+std::string_view ReqView::param_decoded(std::string_view key) const {
+  const std::string_view value = param(key);
+  if (value.find_first_of("%+") == std::string_view::npos)
+    return value;
+
+  auto buf = static_cast<char*>(hts_req_alloc(m_req, value.size()));
+  if (!buf)
+    return std::string_view();
+
+  size_t len = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    int hi, lo;
+    if (value[i] == '+') {
+      buf[len++] = ' ';
+    } else if (value[i] == '%' && i + 2 < value.size() && (hi = hex_value(value[i + 1])) >= 0 && (lo = hex_value(value[i + 2])) >= 0) {
+      buf[len++] = (char) (hi << 4 | lo);
+      i += 2;
+    } else {
+      buf[len++] = value[i];
+    }
+  }
+  return std::string_view(buf, len);
+}
@@ -0,0 +1,20 @@
+#include "http_server_impl.h"
+#include "net_http_server/http_server_setup.h"
+
+#include <uout/uo_callbacks.h>
+
+static void sse_uout_cb(const uoCb_msgT msg) {
+  if (auto json = uoCb_jsonFromMsg(msg))
+    sse_send_json(json, -1);
+}
+
+void hts_sse_uout_setup(const struct uo_flagsT *flags) {
+  uoCb_unsubscribe(sse_uout_cb);
+  if (!flags)
+    return;
+
+  uo_flagsT f = *flags;
+  f.fmt.json = true;
+  f.fmt.txt = false;
+  uoCb_subscribe(sse_uout_cb, f);
+}
@@ -0,0 +1,40 @@
+# Generate a C++ source with static web content from a directory of web assets (see web_bundle.py)
+#
+# Usage (in the CMakeLists.txt of the application or component which serves the files):
+#
+#   include(<path-to>/net_http_server/tools/web_bundle.cmake)
+#   web_bundle_add(${COMPONENT_LIB} "${CMAKE_CURRENT_LIST_DIR}/webapp/dist"
+#                  [PREFIX /]  [BROTLI "*.map" ...]  [OUTPUT <file>])
+#
+# Files are regenerated whenever an asset changes.
+
+set(WEB_BUNDLE_TOOL "${CMAKE_CURRENT_LIST_DIR}/web_bundle.py")
+
+function(web_bundle_add target assets_dir)
+  cmake_parse_arguments(WB "" "OUTPUT;PREFIX" "BROTLI" ${ARGN})
+  if(NOT WB_OUTPUT)
+    set(WB_OUTPUT "${CMAKE_CURRENT_BINARY_DIR}/web_bundle.cc")
+  endif()
+  if(NOT WB_PREFIX)
+    set(WB_PREFIX "/")
+  endif()
+  set(brotli_opts "")
+  foreach(pattern ${WB_BROTLI})
+    list(APPEND brotli_opts "--brotli" "${pattern}")
+  endforeach()
+
+  if(DEFINED PYTHON)
+    set(python "${PYTHON}") # ESP-IDF
+  else()
+    find_package(Python3 REQUIRED COMPONENTS Interpreter)
+    set(python "${Python3_EXECUTABLE}")
+  endif()
+
+  file(GLOB_RECURSE assets CONFIGURE_DEPENDS "${assets_dir}/*")
+  add_custom_command(OUTPUT "${WB_OUTPUT}"
+    COMMAND "${python}" "${WEB_BUNDLE_TOOL}" --prefix "${WB_PREFIX}" ${brotli_opts} -o "${WB_OUTPUT}" "${assets_dir}"
+    DEPENDS ${assets} "${WEB_BUNDLE_TOOL}"
+    COMMENT "Bundling web assets from ${assets_dir}"
+    VERBATIM)
+  target_sources(${target} PRIVATE "${WB_OUTPUT}")
+endfunction()
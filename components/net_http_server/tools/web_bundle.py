@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Bundle a directory of web assets into a C++ source file.
+
+Each file is precompressed (gzip and, if the brotli module is installed, brotli at maximum level) and
+the smallest acceptable encoding is embedded. The generated file defines:
+
+  * wc_bundled_files[] / wc_bundled_files_count:  constexpr file_map table (with ETags)
+  * wc_getContent(uri):  lookup by perfect hash in constant time, without any runtime initialization
+
+Usage: web_bundle.py [--prefix /] [--brotli '*.map'] -o web_bundle.cc ASSETS_DIR
+"""
+
+import argparse
+import fnmatch
+import gzip
+import hashlib
+import mimetypes
+import os
+import sys
+
+try:
+    import brotli
+except ImportError:
+    brotli = None
+
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.htm': 'text/html',
+    '.js': 'text/javascript',
+    '.mjs': 'text/javascript',
+    '.css': 'text/css',
+    '.json': 'application/json',
+    '.map': 'application/json',
+    '.svg': 'image/svg+xml',
+    '.ico': 'image/x-icon',
+    '.png': 'image/png',
+    '.txt': 'text/plain',
+}
+
+FNV_PRIME = 16777619
+FNV_BASIS = 2166136261
+
+
+def uri_hash(uri, seed):
+    """must match the hash function in the generated C++ code"""
+    h = seed
+    for c in uri.encode():
+        h = ((h ^ c) * FNV_PRIME) & 0xffffffff
+    return h
+
+
+def find_perfect_hash(uris):
+    """hash and displace: find a seed per bucket so all URIs get their own slot
+
+    returns (slots, seeds): slot index is uri_hash(uri, seeds[uri_hash(uri, FNV_BASIS) % len(seeds)]) % len(slots)
+    """
+    n_slots = max(1, len(uris) + len(uris) // 8)
+    n_buckets = max(1, (len(uris) + 3) // 4)
+    buckets = [[] for _ in range(n_buckets)]
+    for i, uri in enumerate(uris):
+        buckets[uri_hash(uri, FNV_BASIS) % n_buckets].append(i)
+
+    slots = [-1] * n_slots
+    seeds = [1] * n_buckets
+    for b in sorted(range(n_buckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            continue
+        for seed in range(1, 1 << 20):
+            positions = [uri_hash(uris[i], seed) % n_slots for i in buckets[b]]
+            if len(set(positions)) == len(positions) and all(slots[pos] < 0 for pos in positions):
+                break
+        else:
+            raise RuntimeError('no perfect hash found')
+        seeds[b] = seed
+        for i, pos in zip(buckets[b], positions):
+            slots[pos] = i
+    return slots, seeds
+
+
+def compress(data, path, brotli_patterns):
+    """return (encoding, data) of the smallest allowed variant"""
+    variants = [(None, data), ('gzip', gzip.compress(data, compresslevel=9, mtime=0))]
+    if brotli and any(fnmatch.fnmatch(os.path.basename(path), p) for p in brotli_patterns):
+        variants.append(('br', brotli.compress(data, quality=11)))
+    return min(variants, key=lambda v: len(v[1]))
+
+
+def c_bytes(data):
+    """string literal lines (octal escapes, so no escape can swallow the next character)"""
+    lines = []
+    for i in range(0, len(data), 20):
+        lines.append('  "' + ''.join('\\%03o' % b for b in data[i:i + 20]) + '"')
+    return '\n'.join(lines) if lines else '  ""'
+
+
+def c_str(s):
+    return 'nullptr' if s is None else '"' + s.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def collect_files(assets_dir, prefix):
+    result = []
+    for root, dirs, files in os.walk(assets_dir):
+        dirs.sort()
+        for name in sorted(files):
+            path = os.path.join(root, name)
+            rel = os.path.relpath(path, assets_dir).replace(os.sep, '/')
+            result.append((prefix.rstrip('/') + '/' + rel, path))
+    return result
+
+
+def generate(assets_dir, prefix, brotli_patterns):
+    files = collect_files(assets_dir, prefix)
+    out = ['// generated by web_bundle.py from <%s>. Do not edit.' % os.path.basename(os.path.abspath(assets_dir)),
+           '#include "net_http_server/content.hh"',
+           '#include <stdint.h>',
+           '#include <string.h>',
+           '']
+    entries = []
+    for i, (uri, path) in enumerate(files):
+        with open(path, 'rb') as f:
+            data = f.read()
+        encoding, body = compress(data, path, brotli_patterns)
+        etag = '"%s"' % hashlib.sha1(body).hexdigest()[:16]
+        ext = os.path.splitext(path)[1].lower()
+        mime = MIME_TYPES.get(ext) or mimetypes.guess_type(path)[0] or 'application/octet-stream'
+        out.append('// %s: %u bytes, %s: %u bytes' % (uri, len(data), encoding or 'identity', len(body)))
+        out.append('alignas(4) static constexpr char wb_data_%u[] =' % i)
+        out.append(c_bytes(body) + ';')
+        entries.append('  { %s, %s, { wb_data_%u, %s, %u, %s }, nullptr },' % (c_str(uri), c_str(mime), i, c_str(encoding), len(body), c_str(etag)))
+
+    out.append('')
+    out.append('constexpr struct file_map wc_bundled_files[] = {')
+    # an array must not be empty. The sentinel is never found, because no hash slot refers to it
+    out.extend(entries or ['  { nullptr, nullptr, { nullptr, nullptr, 0, nullptr }, nullptr }, // no assets'])
+    out.append('};')
+    out.append('constexpr unsigned wc_bundled_files_count = %u;' % len(entries))
+    out.append('')
+
+    uris = [uri for uri, _ in files]
+    slots, seeds = find_perfect_hash(uris)
+    idx_type = 'int8_t' if len(uris) < 128 else 'int16_t'
+    seed_type = 'uint8_t' if max(seeds) < 256 else 'uint32_t'
+    out.append('static constexpr %s wb_slots[%u] = { %s };' % (idx_type, len(slots), ', '.join(map(str, slots))))
+    out.append('static constexpr %s wb_seeds[%u] = { %s };' % (seed_type, len(seeds), ', '.join(map(str, seeds))))
+    out.append('''
+static uint32_t wb_hash(const char *uri, size_t len, uint32_t h) {
+  for (size_t i = 0; i < len; ++i)
+    h = (h ^ (uint8_t) uri[i]) * %uu;
+  return h;
+}
+
+const struct file_map* wc_getContent(const char *uri) {
+  const size_t len = strcspn(uri, "?");
+  const uint32_t seed = wb_seeds[wb_hash(uri, len, %uu) %% %uu];
+  const int idx = wb_slots[wb_hash(uri, len, seed) %% %uu];
+  if (idx < 0)
+    return nullptr;
+  const struct file_map *fm = &wc_bundled_files[idx];
+  return (0 == strncmp(fm->uri, uri, len) && fm->uri[len] == '\\0') ? fm : nullptr;
+}
+''' % (FNV_PRIME, FNV_BASIS, len(seeds), len(slots)))
+    return '\n'.join(out)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='bundle web assets into a C++ source file')
+    ap.add_argument('assets_dir')
+    ap.add_argument('-o', '--output', required=True)
+    ap.add_argument('--prefix', default='/', help='URI prefix of all assets (default: /)')
+    ap.add_argument('--brotli', action='append', default=None, metavar='PATTERN',
+                    help="file name pattern allowed to be served brotli compressed (default: '*.map')")
+    args = ap.parse_args()
+
+    if args.brotli is None:
+        args.brotli = ['*.map']
+    if not brotli:
+        print('web_bundle.py: brotli module not found. Using gzip only', file=sys.stderr)
+
+    src = generate(args.assets_dir, args.prefix, args.brotli)
+    # don't touch output if unchanged, to avoid needless rebuilds
+    if os.path.exists(args.output):
+        with open(args.output) as f:
+            if f.read() == src:
+                return
+    with open(args.output, 'w') as f:
+        f.write(src)
+
+
+if __name__ == '__main__':
+    main()
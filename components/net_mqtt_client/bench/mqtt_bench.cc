@@ -0,0 +1,271 @@
+/**
+ * \file   mqtt_bench.cc
+ * \brief  Publish and receive benchmark of the host MQTT client against tools/mqtt_broker_stub.py
+ *
+ *         Usage: mqtt_bench [--count N] [--rate MSG_PER_S] [--size BYTES] [--qos 0..2] [--port PORT] [--url URL]
+ *
+ *         The broker stub is started on PORT unless an URL of another broker is given. Each message is published
+ *         to "bench/load" and received back by a subscription of the same topic. Reported are the publish rate
+ *         with publish to acknowledge latency (QoS > 0), the receive rate with round trip latency, and the heap
+ *         allocations of the whole process (client thread included) per message.
+ *
+ *         A publish rejected because the output buffer is full is retried.  Messages taken by the publish queue
+ *         are counted from its statistics.  Exits with 1 if a message was dropped, not acknowledged or not received.
+ */
+#include "bench.hh"
+#include "net_mqtt_client/mqtt.hh"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef MQTT_BROKER_STUB
+#define MQTT_BROKER_STUB "tools/mqtt_broker_stub.py"
+#endif
+
+#define IDLE_TIMEOUT_MS 5000 ///< stop waiting for outstanding messages after this time without progress
+#define NO_SEQ UINT32_MAX     ///< seq_of_id entry of a message ID not published by us (e.g. sent from the queue)
+
+static struct {
+  unsigned count = 10000;
+  unsigned rate = 0; ///< messages per second. 0 for as fast as possible
+  unsigned size = 64;
+  int qos = 1;
+  int port = 18830;
+  const char *url = nullptr;
+} opt;
+
+static const char *topic;
+static std::vector<uint64_t> sent_ns; ///< publish time by sequence number
+static uint32_t seq_of_id[0x10000];   ///< sequence number by message ID
+static std::mutex id_mutex;           ///< protects seq_of_id
+static std::atomic<unsigned> acked_count, received_count;
+static std::atomic<bool> is_connected, is_subscribed;
+static std::atomic<uint64_t> last_event_ns;
+
+static BenchLatency *ack_latency, *rtt_latency; // only used by the client thread while running
+
+class BenchMqtt: public Net_Mqtt {
+public:
+  void connected() override {
+    is_connected = true;
+  }
+  void disconnected() override {
+    is_connected = false;
+  }
+  void subscribed(const char *topic, int topic_len) override {
+    is_subscribed = true;
+  }
+  void published(int msg_id) override {
+    const uint64_t now = bench_ns_now();
+    uint32_t seq;
+    {
+      std::lock_guard<std::mutex> lock(id_mutex);
+      seq = seq_of_id[msg_id & 0xffff];
+      seq_of_id[msg_id & 0xffff] = NO_SEQ; // IDs are reused
+    }
+    if (seq < sent_ns.size())
+      ack_latency->add(now - sent_ns[seq]);
+    ++acked_count;
+    last_event_ns = now;
+  }
+  void received(const char *topic, int topic_len, const char *data, int data_len) override {
+    const uint64_t now = bench_ns_now();
+    uint32_t seq;
+    if (data_len < int(sizeof seq))
+      return;
+    memcpy(&seq, data, sizeof seq);
+    if (seq < sent_ns.size())
+      rtt_latency->add(now - sent_ns[seq]);
+    ++received_count;
+    last_event_ns = now;
+  }
+};
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [--count N] [--rate MSG_PER_S] [--size BYTES] [--qos 0..2] [--port PORT] [--url URL]\n", prog);
+  exit(2);
+}
+
+static void parse_args(int argc, char *argv[]) {
+  static const struct option long_opts[] = { { "count", required_argument, nullptr, 'n' }, { "rate", required_argument, nullptr, 'r' }, { "size",
+      required_argument, nullptr, 's' }, { "qos", required_argument, nullptr, 'q' }, { "port", required_argument, nullptr, 'p' }, { "url", required_argument,
+      nullptr, 'u' }, { "help", no_argument, nullptr, 'h' }, { } };
+  for (int c; (c = getopt_long(argc, argv, "n:r:s:q:p:u:h", long_opts, nullptr)) != -1;) {
+    switch (c) {
+    case 'n':
+      opt.count = strtoul(optarg, nullptr, 0);
+      break;
+    case 'r':
+      opt.rate = strtoul(optarg, nullptr, 0);
+      break;
+    case 's':
+      opt.size = strtoul(optarg, nullptr, 0);
+      break;
+    case 'q':
+      opt.qos = atoi(optarg);
+      break;
+    case 'p':
+      opt.port = atoi(optarg);
+      break;
+    case 'u':
+      opt.url = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (opt.qos < 0 || opt.qos > 2 || !opt.count)
+    usage(argv[0]);
+  if (opt.size < sizeof(uint32_t))
+    opt.size = sizeof(uint32_t); // payload starts with the sequence number
+}
+
+/// \brief start broker stub listening on PORT. \return its process ID or -1
+static pid_t start_broker(int port) {
+  const std::string port_str = std::to_string(port);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    execlp("python3", "python3", MQTT_BROKER_STUB, "--port", port_str.c_str(), (char*) nullptr);
+    perror("mqtt_bench: exec python3");
+    _exit(127);
+  }
+  if (pid < 0)
+    return -1;
+
+  // wait until it accepts connections
+  for (int i = 0; i < 50; ++i) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sa = { };
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const bool ok = connect(fd, (struct sockaddr*) &sa, sizeof sa) == 0;
+    close(fd);
+    if (ok)
+      return pid;
+    usleep(100000);
+  }
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+  return -1;
+}
+
+static bool wait_for(const std::atomic<bool> &flag, unsigned timeout_ms) {
+  for (unsigned ms = 0; !flag && ms < timeout_ms; ms += 10)
+    usleep(10000);
+  return flag;
+}
+
+int main(int argc, char *argv[]) {
+  parse_args(argc, argv);
+
+  pid_t broker = -1;
+  if (!opt.url && (broker = start_broker(opt.port)) < 0) {
+    fprintf(stderr, "mqtt_bench: cannot start broker stub <%s>\n", MQTT_BROKER_STUB);
+    return 1;
+  }
+
+  static BenchMqtt mqtt;
+  Net_Mqtt::setup(&mqtt);
+  cfg_mqtt cfg;
+  if (opt.url)
+    snprintf(cfg.url, sizeof cfg.url, "%s", opt.url);
+  else
+    snprintf(cfg.url, sizeof cfg.url, "mqtt://127.0.0.1:%d", opt.port);
+  snprintf(cfg.client_id, sizeof cfg.client_id, "mqtt_bench_%d", int(getpid()));
+  snprintf(cfg.root_topic, sizeof cfg.root_topic, "bench");
+  cfg.user[0] = cfg.password[0] = '\0';
+  cfg.enable = 1;
+
+  sent_ns.assign(opt.count, 0);
+  BenchLatency ack_lat(opt.count), rtt_lat(opt.count);
+  ack_latency = &ack_lat;
+  rtt_latency = &rtt_lat;
+  std::vector<char> payload(opt.size, 'x');
+
+  io_mqtt_setup(&cfg);
+  topic = Net_Mqtt::intern_topic("load"); // root topic is set by io_mqtt_setup
+  int result = 1;
+  if (wait_for(is_connected, 5000))
+    mqtt.subscribe(topic, 0);
+  if (!is_connected || !wait_for(is_subscribed, 5000)) {
+    fprintf(stderr, "mqtt_bench: cannot connect and subscribe to <%s>\n", cfg.url);
+    goto out;
+  }
+
+  {
+    printf("%u messages, %u bytes, QoS %d, rate %s\n", opt.count, opt.size, opt.qos, opt.rate ? std::to_string(opt.rate).c_str() : "unlimited");
+    unsigned dropped = 0;
+    std::fill(std::begin(seq_of_id), std::end(seq_of_id), NO_SEQ);
+    mqtt_queue_stats qs_start = { }, qs_end = { };
+    io_mqtt_get_queue_stats(&qs_start);
+    const uint64_t allocs_start = bench_allocs();
+    const uint64_t start = bench_ns_now();
+    last_event_ns = start;
+
+    for (uint32_t seq = 0; seq < opt.count; ++seq) {
+      if (opt.rate) {
+        const uint64_t due = start + uint64_t(seq) * 1000000000 / opt.rate;
+        if (const uint64_t now = bench_ns_now(); now < due)
+          std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+      }
+      memcpy(payload.data(), &seq, sizeof seq);
+      sent_ns[seq] = bench_ns_now();
+      for (;;) {
+        {
+          std::lock_guard<std::mutex> lock(id_mutex);
+          const int id = mqtt.publish_data(topic, payload.data(), payload.size(), opt.qos);
+          if (id > 0)
+            seq_of_id[id & 0xffff] = seq;
+          if (id >= 0) // 0: sent with QoS 0 or taken by the publish queue
+            break;
+        }
+        // -1 while connected: output buffer is full. Retry unless the client makes no progress
+        if (!is_connected || bench_ns_now() - last_event_ns > IDLE_TIMEOUT_MS * 1000000ULL) {
+          ++dropped;
+          break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+    const uint64_t published = bench_ns_now();
+
+    while ((received_count < opt.count || (opt.qos && acked_count < opt.count)) && bench_ns_now() - last_event_ns < IDLE_TIMEOUT_MS * 1000000ULL)
+      usleep(1000);
+    const uint64_t done = last_event_ns;
+    const uint64_t allocs = bench_allocs() - allocs_start;
+    io_mqtt_get_queue_stats(&qs_end);
+    const unsigned queued = qs_end.queued - qs_start.queued, queue_dropped = qs_end.dropped - qs_start.dropped;
+
+    bench_report("publish", opt.count, published - start, opt.qos ? &ack_lat : nullptr, allocs);
+    bench_report("receive", received_count, done - start, &rtt_lat, allocs);
+    printf("queued %u, dropped %u, dropped by queue %u, not acknowledged %u, not received %u\n", queued, dropped, queue_dropped,
+        opt.qos ? opt.count - acked_count : 0, opt.count - received_count);
+    const bool lost = dropped || queue_dropped || received_count < opt.count || (opt.qos && acked_count < opt.count);
+    result = lost ? 1 : 0;
+  }
+
+out:
+  io_mqtt_setup(nullptr);
+  if (broker > 0) {
+    kill(broker, SIGTERM);
+    waitpid(broker, nullptr, 0);
+  }
+  return result;
+}
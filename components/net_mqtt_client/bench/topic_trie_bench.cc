@@ -0,0 +1,106 @@
+/**
+ * \file   topic_trie_bench.cc
+ * \brief  Lookup benchmark of TopicTrie with 500 topic filters, compared with matching each filter in turn
+ *
+ *         Usage: topic_trie_bench [--count N]
+ *
+ *         Latencies are measured per lookup and include the overhead of reading the clock.
+ */
+#include "bench.hh"
+#include "net_mqtt_client/topic_trie.hh"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define FILTERS 500
+#define TOPICS 1024 ///< distinct topics looked up in turn
+
+/// \brief test if FILTER matches TOPIC by walking both level by level
+static bool topic_matches(std::string_view filter, std::string_view topic) {
+  for (;;) {
+    const size_t f_end = filter.find('/'), t_end = topic.find('/');
+    const std::string_view f_level = filter.substr(0, f_end), t_level = topic.substr(0, t_end);
+    if (f_level == "#")
+      return true;
+    if (f_level != "+" && f_level != t_level)
+      return false;
+    if (f_end == filter.npos || t_end == topic.npos)
+      return f_end == t_end || filter.substr(f_end + 1) == "#";
+    filter.remove_prefix(f_end + 1);
+    topic.remove_prefix(t_end + 1);
+  }
+}
+
+/// \brief run FN(topic) COUNT times over TOPICS. \return sum of results of FN
+template<typename Fn>
+static uint64_t run(const char *name, unsigned count, const std::vector<std::string> &topics, Fn &&fn) {
+  BenchLatency latency(count);
+  uint64_t matches = 0;
+  const uint64_t allocs_start = bench_allocs();
+  const uint64_t start = bench_ns_now();
+  for (unsigned i = 0; i < count; ++i) {
+    const std::string &topic = topics[i % topics.size()];
+    const uint64_t t = bench_ns_now();
+    matches += fn(topic);
+    latency.add(bench_ns_now() - t);
+  }
+  const uint64_t elapsed = bench_ns_now() - start;
+  bench_report(name, count, elapsed, &latency, bench_allocs() - allocs_start);
+  return matches;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned count = 1000000;
+  static const struct option long_opts[] = { { "count", required_argument, nullptr, 'n' }, { } };
+  for (int c; (c = getopt_long(argc, argv, "n:", long_opts, nullptr)) != -1;) {
+    if (c != 'n') {
+      fprintf(stderr, "usage: %s [--count N]\n", argv[0]);
+      return 2;
+    }
+    count = strtoul(optarg, nullptr, 0);
+  }
+
+  // filters of a gateway for many devices: commands, configuration subtrees and a few per-function wildcards
+  std::vector<std::string> filters;
+  for (unsigned i = 0; filters.size() < FILTERS; ++i) {
+    filters.push_back("dev" + std::to_string(i) + "/cmd/+");
+    if (i % 5 == 0)
+      filters.push_back("dev" + std::to_string(i) + "/cfg/#");
+    if (i % 50 == 0)
+      filters.push_back("+/ota/" + std::to_string(i));
+  }
+  filters.resize(FILTERS);
+
+  TopicTrie<int> trie;
+  for (size_t i = 0; i < filters.size(); ++i)
+    trie.add(filters[i].c_str(), i);
+
+  std::vector<std::string> topics;
+  for (unsigned i = 0; i < TOPICS; ++i) {
+    const unsigned dev = (i * 7919) % 450;
+    static const char *const suffixes[] = { "/cmd/set", "/cfg/net/ip", "/ota/50", "/status" };
+    topics.push_back("dev" + std::to_string(dev) + suffixes[i % 4]);
+  }
+
+  printf("%u lookups, %u filters, %u topics\n", count, FILTERS, TOPICS);
+  const uint64_t trie_matches = run("TopicTrie", count, topics, [&trie](const std::string &topic) {
+    return trie.for_each_match(topic.data(), topic.size(), [](int) {
+    });
+  });
+  const uint64_t linear_matches = run("linear scan", count, topics, [&filters](const std::string &topic) {
+    int n = 0;
+    for (auto &f : filters)
+      n += topic_matches(f, topic);
+    return n;
+  });
+  if (trie_matches != linear_matches) {
+    fprintf(stderr, "topic_trie_bench: results differ (%llu != %llu)\n", (unsigned long long) trie_matches, (unsigned long long) linear_matches);
+    return 1;
+  }
+  return 0;
+}
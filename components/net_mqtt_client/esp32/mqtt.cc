@@ -2,11 +2,13 @@
 #include "net_mqtt_client/mqtt.hh"
 
 #include "cli/cli.h"
+#include "net/ipnet.h"
 #include <uout/uo_callbacks.h>
 
 #include "esp_system.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "mqtt_client.h"
 
 #include "freertos/FreeRTOS.h"
@@ -18,10 +20,21 @@
 #include "lwip/dns.h"
 #include "lwip/netdb.h"
 #include <net_mqtt_client/mqtt.hh>
+#include "publish_queue.hh"
+#include "mqtt_trace.hh"
+#include "topic_dispatch.hh"
+#include "topic_intern.hh"
+#include "subscriptions.hh"
+#include "reconnect.hh"
+#include "reassembly.hh"
+#include "perf_stats.hh"
 #include <mbedtls/error.h>
 
 #include <stddef.h>
 #include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
 
 #ifdef CONFIG_NET_MQTT_CLIENT_DEBUG
 #define DEBUG
@@ -31,11 +44,137 @@
 #endif
 
 static bool is_connected;
+static esp_mqtt_client_handle_t client;
 constexpr const char *TAG = "mqtt_client";
 #define logtag TAG
 
 // implementation interface
 
+#if defined CONFIG_NET_MQTT_CLIENT_PROTOCOL_5 && CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX > 0
+static std::mutex alias_mutex; ///< protects alias_max and the publish property of the client
+static unsigned alias_max = CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX; ///< lowered to the broker's Topic Alias Maximum
+
+/// \brief the broker's Topic Alias Maximum may have changed: start again with the configured maximum
+static void reset_alias_max() {
+  std::lock_guard<std::mutex> lock(alias_mutex);
+  alias_max = CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX;
+}
+#else
+static void reset_alias_max() {
+}
+#endif
+
+/**
+ * \brief          publish or enqueue a message, using a topic alias for interned topics (MQTT 5)
+ * \param enqueue  use esp_mqtt_client_enqueue instead of blocking esp_mqtt_client_publish
+ */
+static int client_publish(const char *topic, const char *data, size_t data_len, int qos, bool retain, bool enqueue = false) {
+#if defined CONFIG_NET_MQTT_CLIENT_PROTOCOL_5 && CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX > 0
+  // the publish property is stored in the client until changed, so set it for each message and keep it until published
+  std::lock_guard<std::mutex> lock(alias_mutex);
+  const unsigned alias = mqtt_topic_alias(topic);
+  esp_mqtt5_publish_property_config_t prop = { };
+  prop.topic_alias = alias <= alias_max ? alias : 0;
+  if (esp_mqtt5_client_set_publish_property(client, &prop) != ESP_OK && prop.topic_alias) {
+    // rejected because it exceeds the Topic Alias Maximum of the broker's CONNACK. ESP-MQTT has no getter for it
+    alias_max = prop.topic_alias - 1;
+    prop.topic_alias = 0;
+    if (esp_mqtt5_client_set_publish_property(client, &prop) != ESP_OK)
+      return -1; // don't publish with the alias of the previous message
+  }
+#endif
+  const int msg_id = enqueue ? esp_mqtt_client_enqueue(client, topic, data, data_len, qos, retain, true)
+      : esp_mqtt_client_publish(client, topic, data, data_len, qos, retain);
+  if (msg_id >= 0)
+    mqtt_perf_sent(msg_id);
+  return msg_id;
+}
+
+static std::mutex client_cfg_mutex; ///< protects client_cfg
+static cfg_mqtt client_cfg; ///< configuration of the client, used again to change the reconnect delay
+static esp_mqtt_client_config_t make_client_config(struct cfg_mqtt *cmc, unsigned reconnect_ms);
+
+static uint64_t ms_now() {
+  return esp_timer_get_time() / 1000;
+}
+
+/// \brief connection lost or connection attempt failed: make the auto reconnect of ESP-MQTT wait for a backoff delay
+static void schedule_reconnect() {
+  if (!client)
+    return;
+  const unsigned delay_ms = mqtt_reconnect().next_delay_ms(ms_now());
+  D(ESP_LOGI(TAG, "reconnect in %u ms", delay_ms));
+  cfg_mqtt cfg;
+  {
+    std::lock_guard<std::mutex> lock(client_cfg_mutex); // not held while calling ESP-MQTT, which holds its own lock here
+    cfg = client_cfg;
+  }
+  const esp_mqtt_client_config_t mqtt_cfg = make_client_config(&cfg, std::max(delay_ms, 1u));
+  if (esp_mqtt_set_config(client, &mqtt_cfg) != ESP_OK)
+    ESP_LOGW(TAG, "cannot set reconnect delay");
+}
+
+/// \brief pass a complete received message to the application
+static void deliver_message(const char *topic, int topic_len, const char *data, int data_len) {
+  mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_RECEIVED, 0, topic, topic_len, data_len);
+  mqtt_perf_received(data_len);
+  mqtt_topic_dispatch(topic, topic_len, data, data_len);
+  Net_Mqtt::get_this().received(topic, topic_len, data, data_len);
+}
+
+/// \brief restore subscriptions after connecting, using a single SUBSCRIBE packet
+static void resubscribe(bool session_present) {
+  std::vector<MqttSubscriptions::topic_qos> sub;
+  std::vector<std::string> unsub;
+  mqtt_subscriptions().connected(session_present, sub, unsub);
+
+  if (!sub.empty()) {
+    std::vector<esp_mqtt_topic_t> topics(sub.size());
+    for (size_t i = 0; i < sub.size(); ++i)
+      topics[i] = esp_mqtt_topic_t { .filter = sub[i].topic.c_str(), .qos = sub[i].qos };
+    int msg_id = esp_mqtt_client_subscribe_multiple(client, topics.data(), topics.size());
+    mqtt_subscriptions().sent(msg_id, sub);
+    mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_SUBSCRIBE, msg_id, sub[0].topic.data(), sub[0].topic.size(), 0, sub[0].qos);
+  }
+  for (auto &topic : unsub) {
+    int msg_id = esp_mqtt_client_unsubscribe(client, topic.c_str());
+    mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_UNSUBSCRIBE, msg_id, topic.data(), topic.size());
+  }
+}
+
+/// \brief send function for the offline publish queue
+static int send_queued(const char *topic, const char *data, size_t data_len, int qos, bool retain) {
+  if (!client || !is_connected)
+    return -1;
+  return client_publish(topic, data, data_len, qos, retain);
+}
+
+/// \brief send function for draining from the esp_timer task: enqueue into the outbox, so the MQTT task does the sending
+static int enqueue_queued(const char *topic, const char *data, size_t data_len, int qos, bool retain) {
+  if (!client || !is_connected)
+    return -1;
+  return client_publish(topic, data, data_len, qos, retain, true);
+}
+
+static esp_timer_handle_t drain_timer;
+
+/// \brief start the drain timer if QoS 0 slots of the window block the rest of the queue
+static void start_drain_timer() {
+  if (!drain_timer || !is_connected || esp_timer_is_active(drain_timer))
+    return;
+  if (const unsigned ms = mqtt_publish_queue().next_drain_ms())
+    esp_timer_start_once(drain_timer, ms * 1000ULL);
+}
+
+static void drain_queue(MqttPublishQueue::send_fn send) {
+  mqtt_publish_queue().drain(send);
+  start_drain_timer();
+}
+
+static void drain_timer_cb(void *arg) {
+  drain_queue(enqueue_queued);
+}
+
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
 esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(event_data);
@@ -46,54 +185,54 @@ esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(event_data)
   switch (event->event_id) {
   case MQTT_EVENT_CONNECTED:
     is_connected = true;
+    reset_alias_max();
+    mqtt_reconnect().connected(ms_now());
     uoCb_publish_logMessage( { .tag = TAG, .txt = "connected", .warn_level = LogMessage::wl_Info });
+    resubscribe(event->session_present);
     Net_Mqtt::get_this().connected();
+    drain_queue(send_queued);
     break;
 
   case MQTT_EVENT_DISCONNECTED:
     uoCb_publish_logMessage( { .tag = TAG, .txt = "disconnected", .warn_level = LogMessage::wl_Info });
     is_connected = false;
+    schedule_reconnect();
+    mqtt_publish_queue().disconnected();
     Net_Mqtt::get_this().disconnected();
     break;
 
-  case MQTT_EVENT_SUBSCRIBED: {
-    char buf[128];
-    if (sizeof buf >= snprintf(buf, sizeof buf, "subscribed: msg_id=%d", event->msg_id)) {
-      uoCb_publish_logMessage( { .tag = TAG, .txt = buf, .warn_level = LogMessage::wl_Info });
-    }
-  }
+  case MQTT_EVENT_SUBSCRIBED:
+    mqtt_trace(MQTT_TRACE_DEBUG, MQTT_TEV_SUBSCRIBED, event->msg_id);
+    mqtt_subscriptions().acked(event->msg_id, event->data, event->data_len); // data: return codes
     Net_Mqtt::get_this().subscribed(event->topic, event->topic_len);
     break;
 
-  case MQTT_EVENT_UNSUBSCRIBED: {
-    char buf[128];
-    if (sizeof buf >= snprintf(buf, sizeof buf, "unsubscribed: msg_id=%d", event->msg_id)) {
-      uoCb_publish_logMessage( { .tag = TAG, .txt = buf, .warn_level = LogMessage::wl_Info });
-    }
-  }
-
+  case MQTT_EVENT_UNSUBSCRIBED:
+    mqtt_trace(MQTT_TRACE_DEBUG, MQTT_TEV_UNSUBSCRIBED, event->msg_id);
     Net_Mqtt::get_this().unsubscribed(event->topic, event->topic_len);
     break;
 
-  case MQTT_EVENT_PUBLISHED: {
-    char buf[128];
-    if (sizeof buf
-        >= snprintf(buf, sizeof buf, "published: msg_id=%d", event->msg_id)) {
-      uoCb_publish_logMessage( { .tag = TAG, .txt = buf, .warn_level = LogMessage::wl_Info });
-    }
-  }
+  case MQTT_EVENT_PUBLISHED:
+    mqtt_trace(MQTT_TRACE_DEBUG, MQTT_TEV_PUBLISHED, event->msg_id);
+    mqtt_perf_acked(event->msg_id);
     Net_Mqtt::get_this().published(event->msg_id);
+    mqtt_publish_queue().published(event->msg_id);
+    drain_queue(send_queued);
     break;
 
-  case MQTT_EVENT_DATA: {
-    char buf[128];
-    if (sizeof buf >= snprintf(buf, sizeof buf, "received: TOPIC=<%.*s>, DATA=<%.*s>", event->topic_len, event->topic, event->data_len, event->data)) {
-      uoCb_publish_logMessage( { .tag = TAG, .txt = buf, .warn_level = LogMessage::wl_Info });
+  case MQTT_EVENT_DATA:
+    if (event->current_data_offset == 0 && event->data_len >= event->total_data_len) {
+      deliver_message(event->topic, event->topic_len, event->data, event->data_len);
+      break;
+    }
+    // message larger than input buffer of ESP-MQTT
+    if (mqtt_reassembly().fragment(event->topic, event->topic_len, event->data, event->data_len, event->current_data_offset, event->total_data_len,
+        deliver_message) == MqttReassembly::TOO_LARGE) {
+      uoCb_publish_logMessage( { .tag = TAG, .txt = "received message too large. Dropped", .warn_level = LogMessage::wl_Fail });
     }
-  }
-    Net_Mqtt::get_this().received(event->topic, event->topic_len, event->data, event->data_len);
-
     break;
+
+
   case MQTT_EVENT_ERROR: {
     const char *txt = "error";
     if (auto eh = event->error_handle) {
@@ -140,64 +279,115 @@ esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(event_data)
   }
 }
 
-static esp_mqtt_client_handle_t client;
-
 void Net_Mqtt::subscribe(const char *topic, int qos) {
-  if (!client || !is_connected)
+  if (!mqtt_subscriptions().add(topic, qos, client && is_connected))
     return;
 
   int msg_id = esp_mqtt_client_subscribe(client, topic, qos);
-  {
-    char buf[128];
-    if (sizeof buf >= snprintf(buf, sizeof buf, "subscribe: msg_id=%d, TOPIC=<%s>, QOS=<%d>", msg_id, topic, qos)) {
-      uoCb_publish_logMessage( { .tag = TAG, .txt = buf, .warn_level = LogMessage::wl_Info });
-    }
-  }
+  mqtt_subscriptions().sent(msg_id, { MqttSubscriptions::topic_qos { topic, uint8_t(qos) } });
+  mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_SUBSCRIBE, msg_id, topic, strlen(topic), 0, qos);
 }
 
 void Net_Mqtt::unsubscribe(const char *topic) {
-  if (!client || !is_connected)
+  if (!mqtt_subscriptions().remove(topic, client && is_connected))
     return;
 
   int msg_id = esp_mqtt_client_unsubscribe(client, topic);
-  {
-    char buf[128];
-    if (sizeof buf >= snprintf(buf, sizeof buf, "subscribe: msg_id=%d, TOPIC=<%s>", msg_id, topic)) {
-      uoCb_publish_logMessage( { .tag = TAG, .txt = buf, .warn_level = LogMessage::wl_Info });
-    }
-  }
+  mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_UNSUBSCRIBE, msg_id, topic, strlen(topic));
 }
 
-void Net_Mqtt::publish(const char *topic, const char *data, bool retain) {
-  if (!client || !is_connected)
-    return;
-  const int qos = 1;
+/// \brief queue message while offline. Also if the queue is not yet drained, to keep the order of messages. \return see MqttPublishQueue::offer
+static int offer_to_queue(const mqtt_message &m) {
+  const int res = mqtt_publish_queue().offer(m, is_connected, send_queued);
+  if (res <= 0)
+    mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_QUEUED, res, m.topic, strlen(m.topic), m.data_len, m.qos, m.retain);
+  if (res == 0)
+    start_drain_timer();
+  return res;
+}
 
-  int msg_id = esp_mqtt_client_publish(client, topic, data, 0, qos, retain);
-  {
-    char buf[128];
-    if (sizeof buf >= snprintf(buf, sizeof buf, "publish: msg_id=%d, TOPIC=<%s>, DATA=<%s>, QOS=%d, RET=%d", msg_id, topic, data, qos, retain)) {
-      uoCb_publish_logMessage( { .tag = TAG, .txt = buf, .warn_level = LogMessage::wl_Info });
-    } else if (sizeof buf >= snprintf(buf, sizeof buf, "publish: msg_id=%d, TOPIC=<%s>, DATA=<...>, QOS=%d, RET=%d", msg_id, topic, qos, retain)) {
-      uoCb_publish_logMessage( { .tag = TAG, .txt = buf, .warn_level = LogMessage::wl_Info });
+int Net_Mqtt::publish_data(const char *topic, const void *data, size_t data_len, int qos, bool retain) {
+  if (!client)
+    return -1;
+
+  const mqtt_message m { topic, data, data_len, uint8_t(qos), retain };
+  if (int res = offer_to_queue(m); res <= 0)
+    return res;
+
+  int msg_id = client_publish(topic, static_cast<const char*>(data), data_len, qos, retain);
+  mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_PUBLISH, msg_id, topic, strlen(topic), data_len, qos, retain);
+  return msg_id;
+}
+
+int Net_Mqtt::publish_batch(const mqtt_message *msgs, size_t count) {
+  if (!client)
+    return 0;
+
+  int accepted = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const mqtt_message &m = msgs[i];
+    if (int res = offer_to_queue(m); res <= 0) {
+      accepted += res == 0;
+      continue;
     }
+    // enqueue into the outbox without blocking. The MQTT task sends the messages
+    int msg_id = client_publish(m.topic, static_cast<const char*>(m.data), m.data_len, m.qos, m.retain, true);
+    mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_PUBLISH, msg_id, m.topic, strlen(m.topic), m.data_len, m.qos, m.retain);
+    if (msg_id < 0) // outbox full: keep this and the following messages in our queue
+      accepted += mqtt_publish_queue().push(m.topic, static_cast<const char*>(m.data), m.data_len, m.qos, m.retain);
+    else
+      ++accepted;
   }
+  return accepted;
 }
 
-static bool io_mqtt_create_client(struct cfg_mqtt *cmc) {
+/// \param reconnect_ms  delay of ESP-MQTT's auto reconnect (0 for its default), see schedule_reconnect()
+static esp_mqtt_client_config_t make_client_config(struct cfg_mqtt *cmc, unsigned reconnect_ms) {
   esp_mqtt_client_config_t mqtt_cfg = { .broker = { .address = { .uri = cmc->url } }, .credentials = { .username = cmc->user, .client_id = cmc->client_id,
       .authentication = { .password = cmc->password } } };
+#ifdef CONFIG_NET_MQTT_CLIENT_PROTOCOL_5
+  mqtt_cfg.session.protocol_ver = MQTT_PROTOCOL_V_5;
+#endif
+#ifdef CONFIG_NET_MQTT_CLIENT_PERSISTENT_SESSION
+  mqtt_cfg.session.disable_clean_session = true;
+#endif
+  mqtt_cfg.network.reconnect_timeout_ms = reconnect_ms;
+  return mqtt_cfg;
+}
+
+static bool io_mqtt_create_client(struct cfg_mqtt *cmc) {
+  {
+    std::lock_guard<std::mutex> lock(client_cfg_mutex);
+    client_cfg = *cmc;
+  }
+  esp_mqtt_client_config_t mqtt_cfg = make_client_config(cmc, 0); // the DISCONNECTED event sets the delay
 
   if (mqtt_cfg.broker.address.uri && *mqtt_cfg.broker.address.uri == '\0') {
     ESP_LOGE(TAG, "MQTT-URI is configured empty");
     return false;
   }
 
+  mqtt_reassembly().reserve();
+  if (!drain_timer) {
+    const esp_timer_create_args_t timer_args = { .callback = drain_timer_cb, .name = "mqtt_drain" };
+    if (esp_timer_create(&timer_args, &drain_timer) != ESP_OK) {
+      ESP_LOGE(TAG, "drain timer create failed");
+      return false;
+    }
+  }
+  mqtt_reconnect().seed(cmc->client_id, ms_now());
+
   if (!(client = esp_mqtt_client_init(&mqtt_cfg))) {
     ESP_LOGE(TAG, "client_init failed");
     return false;
   }
 
+#if defined CONFIG_NET_MQTT_CLIENT_PROTOCOL_5 && defined CONFIG_NET_MQTT_CLIENT_PERSISTENT_SESSION
+  esp_mqtt5_connection_property_config_t connect_property = { };
+  connect_property.session_expiry_interval = 3600;
+  esp_mqtt5_client_set_connect_property(client, &connect_property);
+#endif
+
   if (esp_mqtt_client_register_event(client, static_cast<esp_mqtt_event_id_t>(ESP_EVENT_ANY_ID), mqtt_event_handler, NULL)) {
     ESP_LOGE(TAG, "register_event failed");
     return false;
@@ -206,7 +396,31 @@ static bool io_mqtt_create_client(struct cfg_mqtt *cmc) {
   return true;
 }
 
+/// \brief apply new configuration to running client and reconnect now. \return false if client must be created again
+static bool io_mqtt_reconfigure(struct cfg_mqtt *c) {
+  if (!client || !*c->url)
+    return false;
+  esp_mqtt_client_config_t mqtt_cfg = make_client_config(c, 0);
+  if (esp_mqtt_set_config(client, &mqtt_cfg) != ESP_OK)
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(client_cfg_mutex);
+    client_cfg = *c;
+  }
+  mqtt_reconnect().reset();
+
+  if (is_connected)
+    return esp_mqtt_client_disconnect(client) == ESP_OK; // DISCONNECTED event sets a fast reconnect delay
+  // fails if the client is not waiting to reconnect, e.g. while connecting with the old configuration
+  if (esp_mqtt_client_reconnect(client) == ESP_OK)
+    return true;
+  esp_mqtt_client_stop(client);
+  return esp_mqtt_client_start(client) == ESP_OK;
+}
+
 static void io_mqtt_stop_and_destroy(void) {
+  if (drain_timer)
+    esp_timer_stop(drain_timer);
   if (client) {
     esp_mqtt_client_stop(client);
     esp_mqtt_client_destroy(client);
@@ -226,8 +440,24 @@ static bool io_mqtt_create_and_start(struct cfg_mqtt *c) {
   return ok;
 }
 
+/// \brief got an IP address: connect now instead of waiting for the backoff delay, which may be long after an outage
+static void mqtt_ipnet_event(unsigned events, void *arg) {
+  if (!(events & IPNET_EVENT_GOT_IP) || !client || is_connected)
+    return;
+  mqtt_reconnect().reset();
+  if (esp_mqtt_client_reconnect(client) != ESP_OK)
+    D(ESP_LOGI(TAG, "reconnect: client is not waiting"));
+}
+
 void io_mqtt_setup(struct cfg_mqtt *c) {
+  static bool subscribed;
+  if (!subscribed)
+    subscribed = ipnet_event_subscribe(IPNET_EVENT_GOT_IP, mqtt_ipnet_event, nullptr);
+
   if (c && c->enable) {
+    mqtt_topic_dispatch_setup(c->root_topic);
+    if (io_mqtt_reconfigure(c))
+      return;
     if (!io_mqtt_create_and_start(c)) {
       ESP_LOGE(TAG, "setup: create/start client failed)");
     }
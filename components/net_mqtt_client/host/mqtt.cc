@@ -1,21 +1,950 @@
-
+/**
+ * \file  host/mqtt.cc
+ * \brief MQTT 3.1.1 / 5 client for host (Linux) running its own event loop thread
+ */
 #include "net_mqtt_client/mqtt.hh"
+#include "publish_queue.hh"
+#include "mqtt_trace.hh"
+#include "topic_dispatch.hh"
+#include "topic_intern.hh"
+#include "subscriptions.hh"
+#include "reconnect.hh"
+#include "perf_stats.hh"
 
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#ifdef CONFIG_NET_MQTT_CLIENT_DEBUG
+#define DEBUG
+#define D(x) x
+#else
+#define D(x)
+#endif
+#define logtag "mqtt_client"
 
-void Net_Mqtt::subscribe(const char *topic, int qos) {
+#define KEEPALIVE_S 60
+#define SESSION_EXPIRY_S 3600 ///< MQTT 5 session expiry interval for persistent sessions
+#define MAX_PACKET_LEN (256 * 1024) ///< larger incoming packets will close the connection
+#define OUT_BUF_SIZE (256 * 1024) ///< unsent and unacknowledged publish data beyond this goes to the offline queue
+
+#ifdef CONFIG_NET_MQTT_CLIENT_PROTOCOL_5
+#define PROTOCOL_LEVEL 5
+#else
+#define PROTOCOL_LEVEL 4
+#endif
+#ifndef CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX
+#define CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX 0
+#endif
+
+/// \brief MQTT control packet types (upper nibble of first byte)
+enum : uint8_t {
+  PT_CONNECT = 0x10, PT_CONNACK = 0x20, PT_PUBLISH = 0x30, PT_PUBACK = 0x40, PT_PUBREC = 0x50, PT_PUBREL = 0x60, PT_PUBCOMP = 0x70,
+  PT_SUBSCRIBE = 0x80, PT_SUBACK = 0x90, PT_UNSUBSCRIBE = 0xA0, PT_UNSUBACK = 0xB0, PT_PINGREQ = 0xC0, PT_PINGRESP = 0xD0, PT_DISCONNECT = 0xE0,
+};
+
+static uint64_t ms_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+//////////////////////////packet encoding//////////////////////
+static void put_u16(std::string &s, unsigned v) {
+  s.push_back(char(v >> 8));
+  s.push_back(char(v & 0xff));
+}
+
+static void put_str(std::string &s, std::string_view v) {
+  put_u16(s, v.size());
+  s.append(v);
+}
+
+static void put_varint(std::string &s, size_t v) {
+  do {
+    uint8_t b = v & 0x7f;
+    v >>= 7;
+    s.push_back(char(v ? b | 0x80 : b));
+  } while (v);
+}
+
+/// \brief append packet with fixed header to OUT
+static void put_packet(std::string &out, uint8_t type_flags, std::string_view body) {
+  out.push_back(char(type_flags));
+  put_varint(out, body.size());
+  out.append(body);
+}
+
+static bool get_u16(std::string_view &s, unsigned &v) {
+  if (s.size() < 2)
+    return false;
+  v = uint8_t(s[0]) << 8 | uint8_t(s[1]);
+  s.remove_prefix(2);
+  return true;
+}
+
+static bool get_varint(std::string_view &s, size_t &v) {
+  v = 0;
+  for (unsigned i = 0; i < 4 && i < s.size(); ++i) {
+    v |= size_t(uint8_t(s[i]) & 0x7f) << (7 * i);
+    if (!(s[i] & 0x80)) {
+      s.remove_prefix(i + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+/// \brief skip MQTT 5 properties
+static bool skip_properties(std::string_view &s) {
+  if (PROTOCOL_LEVEL < 5)
+    return true;
+  size_t len;
+  if (!get_varint(s, len) || len > s.size())
+    return false;
+  s.remove_prefix(len);
+  return true;
+}
+
+/// \brief MQTT 5 property identifiers used here
+enum : uint8_t {
+  PROP_SESSION_EXPIRY_INTERVAL = 0x11, PROP_TOPIC_ALIAS_MAXIMUM = 0x22, PROP_TOPIC_ALIAS = 0x23,
+};
+
+/**
+ * \brief        find a two byte integer property
+ * \param props  properties (without length)
+ * \return       false if not found or malformed
+ */
+static bool find_property_u16(std::string_view props, uint8_t prop_id, unsigned &value) {
+  while (!props.empty()) {
+    const uint8_t id = props[0];
+    props.remove_prefix(1);
+    size_t skip = 0;
+    switch (id) {
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+      skip = 1;
+      break;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+      if (id == prop_id)
+        return get_u16(props, value);
+      skip = 2;
+      break;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+      skip = 4;
+      break;
+    case 0x0B: { // subscription identifier
+      size_t v;
+      if (!get_varint(props, v))
+        return false;
+      break;
+    }
+    case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F: {
+      unsigned len;
+      if (!get_u16(props, len))
+        return false;
+      skip = len;
+      break;
+    }
+    case 0x26: { // string pair
+      unsigned len;
+      if (!get_u16(props, len) || len > props.size())
+        return false;
+      props.remove_prefix(len);
+      if (!get_u16(props, len))
+        return false;
+      skip = len;
+      break;
+    }
+    default:
+      return false;
+    }
+    if (skip > props.size())
+      return false;
+    props.remove_prefix(skip);
+  }
+  return false;
 }
 
+static int send_queued(const char *topic, const char *data, size_t data_len, int qos, bool retain);
+
+/**
+ * \brief  MQTT client connecting to a broker (plain TCP) and reconnecting if the connection is lost
+ *
+ *         The event loop runs in its own thread. Net_Mqtt callbacks are called from this thread.
+ *         publish/subscribe/unsubscribe are thread safe.
+ */
+class MqttHostClient {
+public:
+  explicit MqttHostClient(const cfg_mqtt &cfg) :
+      m_cfg(cfg) {
+  }
+  ~MqttHostClient() {
+    stop();
+  }
+
+public:
+  bool start() {
+    if (!parse_url(m_cfg.url, m_host, m_port)) {
+      fprintf(stderr, logtag ": unsupported URL <%s> (expected mqtt://host[:port])\n", m_cfg.url);
+      return false;
+    }
+    mqtt_reconnect().seed(m_cfg.client_id, ms_now());
+    if ((m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+      perror(logtag ": eventfd");
+      return false;
+    }
+    m_thread = std::thread([this] {
+      event_loop();
+    });
+    return true;
+  }
+
+  void stop() {
+    if (m_thread.joinable()) {
+      m_stop = true;
+      wakeup();
+      m_thread.join();
+    }
+    if (m_event_fd >= 0)
+      ::close(m_event_fd);
+    m_event_fd = -1;
+  }
+
+  bool is_connected() const {
+    return m_connected;
+  }
+
+  /**
+   * \brief  use new configuration. The event loop closes the connection and connects again immediately
+   * \return false if the URL is not supported (nothing is changed then)
+   */
+  bool reconfigure(const cfg_mqtt &cfg) {
+    std::string host, port;
+    if (!parse_url(cfg.url, host, port)) {
+      fprintf(stderr, logtag ": unsupported URL <%s> (expected mqtt://host[:port])\n", cfg.url);
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_new_cfg = cfg;
+    m_new_host = std::move(host);
+    m_new_port = std::move(port);
+    m_reconfigure = true;
+    wakeup();
+    return true;
+  }
+
+  /// \brief queue PUBLISH packet. \return packet ID (0 for QoS 0) or -1 if not connected or output buffer is full
+  int publish(const char *topic, const char *data, size_t data_len, int qos, bool retain) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_connected || out_full())
+      return -1;
+    const int id = put_publish(mqtt_message { topic, data, data_len, uint8_t(qos), retain });
+    wakeup();
+    return id;
+  }
+
+  /// \brief queue PUBLISH packets to be sent by a single write. \return number of queued packets or -1 if not connected or output buffer is full
+  int publish_batch(const mqtt_message *msgs, size_t count) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_connected || out_full())
+      return -1;
+    for (size_t i = 0; i < count; ++i) {
+      [[maybe_unused]] const int id = put_publish(msgs[i]);
+      mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_PUBLISH, id, msgs[i].topic, strlen(msgs[i].topic), msgs[i].data_len, msgs[i].qos, msgs[i].retain);
+    }
+    wakeup();
+    return count;
+  }
+
+  /// \brief queue SUBSCRIBE packet. \return packet ID or -1 if not connected
+  int subscribe(const char *topic, int qos) {
+    return subscribe_multiple( { MqttSubscriptions::topic_qos { topic, uint8_t(qos) } });
+  }
+
+  /// \brief queue a single SUBSCRIBE packet for all TOPICS. \return packet ID or -1 if not connected
+  int subscribe_multiple(const std::vector<MqttSubscriptions::topic_qos> &topics) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_connected)
+      return -1;
+    const int id = next_packet_id();
+    std::string body;
+    put_u16(body, id);
+    if (PROTOCOL_LEVEL >= 5)
+      put_varint(body, 0);
+    auto &pending = m_pending_topics[id];
+    for (auto &t : topics) {
+      put_str(body, t.topic);
+      body.push_back(char(t.qos & 3));
+      pending.push_back(t.topic);
+    }
+    mqtt_subscriptions().sent(id, topics); // before the SUBACK can arrive
+    put_packet(m_out, PT_SUBSCRIBE | 0x02, body);
+    wakeup();
+    return id;
+  }
+
+  /// \brief queue UNSUBSCRIBE packet. \return packet ID or -1 if not connected
+  int unsubscribe(const char *topic) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_connected)
+      return -1;
+    const int id = next_packet_id();
+    std::string body;
+    put_u16(body, id);
+    if (PROTOCOL_LEVEL >= 5)
+      put_varint(body, 0);
+    put_str(body, topic);
+    put_packet(m_out, PT_UNSUBSCRIBE | 0x02, body);
+    m_pending_topics[id].push_back(topic);
+    wakeup();
+    return id;
+  }
+
+private:
+  /// \brief QoS>0 message not yet acknowledged by the broker. Sent again after reconnecting
+  struct unacked_msg {
+    std::string topic;
+    std::string data;
+    uint8_t qos;
+    bool retain;
+    bool released; ///< PUBREC received: PUBREL is sent again instead of PUBLISH
+    size_t size() const {
+      return topic.size() + data.size() + sizeof(unacked_msg);
+    }
+  };
+
+  /// \brief test if publishing has to wait for the broker (with m_mutex locked)
+  bool out_full() const {
+    return m_out.size() + m_unacked_size >= OUT_BUF_SIZE;
+  }
+
+  /// \brief append PUBLISH packet to output buffer and remember it until acknowledged (with m_mutex locked). \return packet ID
+  int put_publish(const mqtt_message &m) {
+    const int id = m.qos > 0 ? next_packet_id() : 0;
+    if (id) {
+      unacked_msg u { m.topic, std::string(static_cast<const char*>(m.data), m.data_len), m.qos, m.retain, false };
+      m_unacked_size += u.size();
+      m_unacked.emplace(id, std::move(u));
+    }
+    put_publish_packet(m, id, false);
+    mqtt_perf_sent(id);
+    return id;
+  }
+
+  /// \brief append PUBLISH packet with packet ID (0 for QoS 0) to output buffer (with m_mutex locked)
+  void put_publish_packet(const mqtt_message &m, unsigned id, bool dup) {
+    const unsigned alias = m_alias_max ? mqtt_topic_alias(m.topic) : 0;
+    const bool use_alias = alias && alias <= m_alias_max;
+    std::string body;
+    if (use_alias && m_alias_sent[alias - 1]) {
+      put_u16(body, 0); // topic is replaced by alias
+    } else {
+      put_str(body, m.topic);
+      if (use_alias)
+        m_alias_sent[alias - 1] = true;
+    }
+    if (id)
+      put_u16(body, id);
+    if (PROTOCOL_LEVEL >= 5) {
+      if (use_alias) {
+        put_varint(body, 3);
+        body.push_back(char(PROP_TOPIC_ALIAS));
+        put_u16(body, alias);
+      } else {
+        put_varint(body, 0);
+      }
+    }
+    body.append(static_cast<const char*>(m.data), m.data_len);
+    put_packet(m_out, PT_PUBLISH | (dup ? 0x08 : 0) | (m.qos & 3) << 1 | (m.retain ? 1 : 0), body);
+  }
+
+  /// \brief send unacknowledged messages of the previous connection again (with m_mutex locked)
+  void resend_unacked() {
+    for (auto &[id, u] : m_unacked) {
+      if (u.released) {
+        std::string body;
+        put_u16(body, id);
+        put_packet(m_out, PT_PUBREL | 0x02, body);
+      } else {
+        put_publish_packet(mqtt_message { u.topic.c_str(), u.data.data(), u.data.size(), u.qos, u.retain }, id, true);
+      }
+    }
+  }
+
+  /// \brief message ID has been acknowledged by PUBACK or PUBCOMP
+  void forget_unacked(unsigned id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_unacked.find(id); it != m_unacked.end()) {
+      m_unacked_size -= it->second.size();
+      m_unacked.erase(it);
+    }
+  }
+
+  static bool parse_url(std::string_view url, std::string &host, std::string &port) {
+    for (auto scheme : { "mqtt://", "tcp://" }) {
+      if (url.substr(0, strlen(scheme)) == scheme) {
+        url.remove_prefix(strlen(scheme));
+        break;
+      }
+    }
+    if (url.find("://") != std::string_view::npos)
+      return false;
+    url = url.substr(0, url.find('/'));
+    if (url.empty())
+      return false;
+
+    port = "1883";
+    if (auto colon = url.rfind(':'); colon != std::string_view::npos && url.find(']') == std::string_view::npos) {
+      port = std::string(url.substr(colon + 1));
+      url = url.substr(0, colon);
+    }
+    if (url.size() > 2 && url.front() == '[' && url.back() == ']')
+      url = url.substr(1, url.size() - 2);
+    host = std::string(url);
+    return true;
+  }
+
+  void wakeup() {
+    uint64_t one = 1;
+    if (write(m_event_fd, &one, sizeof one) < 0) {
+      D(perror(logtag ": eventfd write"));
+    }
+  }
+
+  /// \brief get a packet ID not used by unacknowledged packets (with m_mutex locked)
+  uint16_t next_packet_id() {
+    do {
+      if (++m_packet_id == 0)
+        m_packet_id = 1;
+    } while (m_unacked.count(m_packet_id) || m_pending_topics.count(m_packet_id));
+    return m_packet_id;
+  }
+
+  //////////////////////////connection//////////////////////
+  bool open_socket() {
+    struct addrinfo hints = { }, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (int err = getaddrinfo(m_host.c_str(), m_port.c_str(), &hints, &res); err) {
+      fprintf(stderr, logtag ": cannot resolve <%s>: %s\n", m_host.c_str(), gai_strerror(err));
+      return false;
+    }
+
+    for (auto ai = res; ai; ai = ai->ai_next) {
+      const int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+      if (fd < 0)
+        continue;
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+        m_sock = fd;
+        break;
+      }
+      ::close(fd);
+    }
+    freeaddrinfo(res);
+    return m_sock >= 0;
+  }
+
+  void send_connect() {
+    std::string body;
+    put_str(body, "MQTT");
+    body.push_back(char(PROTOCOL_LEVEL));
+    const bool has_user = *m_cfg.user, has_password = *m_cfg.password;
+#ifdef CONFIG_NET_MQTT_CLIENT_PERSISTENT_SESSION
+    const bool clean_session = false;
+#else
+    const bool clean_session = true;
+#endif
+    body.push_back(char((has_user ? 0x80 : 0) | (has_password ? 0x40 : 0) | (clean_session ? 0x02 : 0)));
+    put_u16(body, KEEPALIVE_S);
+    if (PROTOCOL_LEVEL >= 5) {
+      if (clean_session) {
+        put_varint(body, 0);
+      } else {
+        put_varint(body, 5);
+        body.push_back(char(PROP_SESSION_EXPIRY_INTERVAL));
+        put_u16(body, SESSION_EXPIRY_S >> 16);
+        put_u16(body, SESSION_EXPIRY_S & 0xffff);
+      }
+    }
+    put_str(body, m_cfg.client_id);
+    if (has_user)
+      put_str(body, m_cfg.user);
+    if (has_password)
+      put_str(body, m_cfg.password);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_out.clear();
+    put_packet(m_out, PT_CONNECT, body);
+  }
+
+  void close_socket() {
+    if (m_sock < 0)
+      return;
+    ::close(m_sock);
+    m_sock = -1;
+    m_in.clear();
+    m_tcp_connecting = false;
+    if (!m_stop) {
+      const uint64_t now = ms_now();
+      m_next_connect_ms = now + mqtt_reconnect().next_delay_ms(now);
+    }
+
+    bool was_connected;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      was_connected = m_connected;
+      m_connected = false;
+      m_out.clear(); // unacknowledged messages are kept in m_unacked
+      m_pending_topics.clear();
+    }
+    if (was_connected) {
+      fprintf(stderr, logtag ": disconnected\n");
+      mqtt_publish_queue().disconnected();
+      Net_Mqtt::get_this().disconnected();
+    }
+  }
+
+  //////////////////////////event loop//////////////////////
+  /// \brief apply configuration set by \ref reconfigure
+  void apply_new_config() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_reconfigure)
+        return;
+      m_reconfigure = false;
+      m_cfg = m_new_cfg;
+      m_host = m_new_host;
+      m_port = m_new_port;
+    }
+    if (m_connected) {
+      const char disconnect[] = { char(PT_DISCONNECT), 0 };
+      ::send(m_sock, disconnect, sizeof disconnect, MSG_NOSIGNAL);
+    }
+    close_socket();
+    mqtt_reconnect().reset();
+    m_next_connect_ms = 0; // connect now
+  }
+
+  void event_loop() {
+    while (!m_stop) {
+      apply_new_config();
+      const uint64_t now = ms_now();
+      if (m_sock < 0 && now >= m_next_connect_ms) {
+        if (open_socket()) {
+          m_tcp_connecting = true;
+          m_last_rx_ms = now;
+          send_connect();
+        } else {
+          m_next_connect_ms = now + mqtt_reconnect().next_delay_ms(now);
+        }
+      }
+
+      if (m_sock >= 0 && now - m_last_rx_ms > KEEPALIVE_S * 1500) {
+        fprintf(stderr, logtag ": broker not responding\n");
+        close_socket();
+      } else if (m_connected && now - m_last_tx_ms > KEEPALIVE_S * 1000) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        put_packet(m_out, PT_PINGREQ, { });
+      }
+
+      bool want_write;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        want_write = !m_out.empty();
+      }
+      struct pollfd pfds[2] = { { m_event_fd, POLLIN, 0 }, { m_sock, short(POLLIN | (want_write || m_tcp_connecting ? POLLOUT : 0)), 0 } };
+      int timeout_ms = 1000;
+      if (m_sock < 0 && m_next_connect_ms < now + timeout_ms)
+        timeout_ms = m_next_connect_ms > now ? m_next_connect_ms - now : 0;
+      const unsigned drain_ms = m_connected ? mqtt_publish_queue().next_drain_ms() : 0;
+      if (drain_ms && int(drain_ms) < timeout_ms)
+        timeout_ms = drain_ms;
+      const int n = poll(pfds, m_sock >= 0 ? 2 : 1, timeout_ms);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        perror(logtag ": poll");
+        break;
+      }
+
+      if (pfds[0].revents & POLLIN) {
+        uint64_t count;
+        if (read(m_event_fd, &count, sizeof count) < 0) {
+          D(perror(logtag ": eventfd read"));
+        }
+      }
+      if (drain_ms && m_connected)
+        mqtt_publish_queue().drain(send_queued); // QoS 0 slots of the window are free again
+      if (m_sock < 0)
+        continue;
+
+      if (pfds[1].revents & (POLLERR | POLLHUP)) {
+        int err = 0;
+        socklen_t len = sizeof err;
+        getsockopt(m_sock, SOL_SOCKET, SO_ERROR, &err, &len);
+        D(fprintf(stderr, logtag ": socket error: %s\n", strerror(err)));
+        close_socket();
+        continue;
+      }
+      if (pfds[1].revents & POLLOUT)
+        m_tcp_connecting = false;
+      if ((pfds[1].revents & POLLIN) && !read_input())
+        continue;
+      flush_output();
+    }
+
+    if (m_connected) {
+      const char disconnect[] = { char(PT_DISCONNECT), 0 };
+      ::send(m_sock, disconnect, sizeof disconnect, MSG_NOSIGNAL);
+    }
+    close_socket();
+  }
+
+  /// \brief read and process all available input. \return false if connection was closed
+  bool read_input() {
+    char buf[4096];
+    for (;;) {
+      const ssize_t n = ::read(m_sock, buf, sizeof buf);
+      if (n > 0) {
+        m_in.append(buf, n);
+        continue;
+      }
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
+      close_socket(); // EOF or error
+      return false;
+    }
+    m_last_rx_ms = ms_now();
+
+    std::string_view in(m_in);
+    while (!in.empty()) {
+      std::string_view rest = in.substr(1);
+      size_t len;
+      if (!get_varint(rest, len)) {
+        if (in.size() > 5)
+          return protocol_error("bad remaining length");
+        break;
+      }
+      if (len > MAX_PACKET_LEN)
+        return protocol_error("packet too large");
+      if (rest.size() < len)
+        break;
+      if (!handle_packet(uint8_t(in[0]), rest.substr(0, len)))
+        return protocol_error("malformed packet");
+      if (m_sock < 0)
+        return false;
+      in = rest.substr(len);
+    }
+    m_in.erase(0, m_in.size() - in.size());
+    return true;
+  }
+
+  bool protocol_error(const char *msg) {
+    fprintf(stderr, logtag ": protocol error: %s\n", msg);
+    close_socket();
+    return false;
+  }
+
+  void flush_output() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      const bool was_full = out_full();
+      while (!m_out.empty()) {
+        const ssize_t n = ::send(m_sock, m_out.data(), m_out.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+          if (errno == EINTR)
+            continue;
+          if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            D(perror(logtag ": send"));
+          }
+          break;
+        }
+        m_out.erase(0, n);
+        m_last_tx_ms = ms_now();
+      }
+      if (!was_full || out_full())
+        return;
+    }
+    mqtt_publish_queue().drain(send_queued); // messages queued while the output buffer was full
+  }
+
+  void queue_ack(uint8_t type_flags, unsigned id) {
+    std::string body;
+    put_u16(body, id);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    put_packet(m_out, type_flags, body);
+  }
+
+  std::vector<std::string> take_pending_topics(unsigned id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> topics;
+    if (auto it = m_pending_topics.find(id); it != m_pending_topics.end()) {
+      topics = std::move(it->second);
+      m_pending_topics.erase(it);
+    }
+    return topics;
+  }
+
+  /// \brief restore subscriptions after connecting
+  void resubscribe(bool session_present) {
+    std::vector<MqttSubscriptions::topic_qos> sub;
+    std::vector<std::string> unsub;
+    mqtt_subscriptions().connected(session_present, sub, unsub);
+    if (!sub.empty())
+      subscribe_multiple(sub);
+    for (auto &topic : unsub)
+      unsubscribe(topic.c_str());
+  }
+
+  /// \brief process a complete packet. \return false if malformed
+  bool handle_packet(uint8_t hdr, std::string_view body) {
+    auto &mqtt = Net_Mqtt::get_this();
+    unsigned id = 0;
+
+    switch (hdr & 0xf0) {
+    case PT_CONNACK: {
+      if (body.size() < 2)
+        return false;
+      const uint8_t code = body[1];
+      if (code != 0) {
+        fprintf(stderr, logtag ": connection refused by broker (code %u)\n", code);
+        close_socket();
+        return true;
+      }
+      {
+        unsigned alias_max = 0;
+        if (PROTOCOL_LEVEL >= 5 && CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX > 0) {
+          std::string_view props = body.substr(2);
+          size_t len;
+          if (!get_varint(props, len) || len > props.size())
+            return false;
+          if (!find_property_u16(props.substr(0, len), PROP_TOPIC_ALIAS_MAXIMUM, alias_max))
+            alias_max = 0;
+          if (alias_max > CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX)
+            alias_max = CONFIG_NET_MQTT_CLIENT_TOPIC_ALIAS_MAX;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_connected = true;
+        m_alias_max = alias_max; // aliases are valid per connection only
+        m_alias_sent.assign(alias_max, false);
+        resend_unacked();
+      }
+      mqtt_reconnect().connected(ms_now());
+      fprintf(stderr, logtag ": connected\n");
+      resubscribe(body[0] & 0x01);
+      mqtt.connected();
+      mqtt_publish_queue().drain(send_queued);
+      return true;
+    }
+
+    case PT_PUBLISH: {
+      const int qos = (hdr >> 1) & 3;
+      unsigned topic_len;
+      if (!get_u16(body, topic_len) || topic_len > body.size())
+        return false;
+      const std::string_view topic = body.substr(0, topic_len);
+      body.remove_prefix(topic_len);
+      if (qos && !get_u16(body, id))
+        return false;
+      if (!skip_properties(body))
+        return false;
+      if (qos == 1)
+        queue_ack(PT_PUBACK, id);
+      else if (qos == 2)
+        queue_ack(PT_PUBREC, id);
+      mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_RECEIVED, id, topic.data(), topic.size(), body.size(), qos);
+      mqtt_topic_dispatch(topic.data(), topic.size(), body.data(), body.size());
+      mqtt_perf_received(body.size());
+      mqtt.received(topic.data(), topic.size(), body.data(), body.size());
+      return true;
+    }
+
+    case PT_PUBACK:
+    case PT_PUBCOMP:
+      if (!get_u16(body, id))
+        return false;
+      forget_unacked(id);
+      mqtt_trace(MQTT_TRACE_DEBUG, MQTT_TEV_PUBLISHED, id);
+      mqtt_perf_acked(id);
+      mqtt.published(id);
+      mqtt_publish_queue().published(id);
+      mqtt_publish_queue().drain(send_queued);
+      return true;
+
+    case PT_PUBREC:
+      if (!get_u16(body, id))
+        return false;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (auto it = m_unacked.find(id); it != m_unacked.end())
+          it->second.released = true;
+      }
+      queue_ack(PT_PUBREL | 0x02, id);
+      return true;
+
+    case PT_PUBREL:
+      if (!get_u16(body, id))
+        return false;
+      queue_ack(PT_PUBCOMP, id);
+      return true;
+
+    case PT_SUBACK:
+    case PT_UNSUBACK: {
+      if (!get_u16(body, id))
+        return false;
+      mqtt_trace(MQTT_TRACE_DEBUG, (hdr & 0xf0) == PT_SUBACK ? MQTT_TEV_SUBSCRIBED : MQTT_TEV_UNSUBSCRIBED, id);
+      if ((hdr & 0xf0) == PT_SUBACK) {
+        if (!skip_properties(body))
+          return false;
+        mqtt_subscriptions().acked(id, body.data(), body.size()); // remaining body: a return code per topic
+      }
+      for (auto &topic : take_pending_topics(id)) {
+        if ((hdr & 0xf0) == PT_SUBACK)
+          mqtt.subscribed(topic.data(), topic.size());
+        else
+          mqtt.unsubscribed(topic.data(), topic.size());
+      }
+      return true;
+    }
+
+    case PT_PINGRESP:
+      return true;
+
+    case PT_DISCONNECT:
+      close_socket();
+      return true;
+
+    default:
+      return false;
+    }
+  }
+
+private:
+  cfg_mqtt m_cfg;
+  std::string m_host, m_port;
+  std::thread m_thread;
+  std::atomic<bool> m_stop { false };
+  int m_event_fd = -1;
+  int m_sock = -1;
+  bool m_tcp_connecting = false;
+  uint64_t m_next_connect_ms = 0, m_last_rx_ms = 0, m_last_tx_ms = 0;
+  std::string m_in; ///< received data not yet processed (event loop only)
+
+  std::mutex m_mutex; ///< protects the members below
+  std::string m_out; ///< packets not yet sent
+  std::atomic<bool> m_connected { false };
+  uint16_t m_packet_id = 0;
+  unsigned m_alias_max = 0; ///< topic aliases usable on this connection
+  std::vector<bool> m_alias_sent; ///< alias has been sent together with its topic on this connection
+  std::map<uint16_t, unacked_msg> m_unacked; ///< QoS>0 messages by packet ID. Kept across reconnects
+  size_t m_unacked_size = 0; ///< sum of m_unacked sizes
+  std::map<uint16_t, std::vector<std::string>> m_pending_topics; ///< topics of (UN)SUBSCRIBE packets waiting for their ACK
+  bool m_reconfigure = false; ///< new configuration below has to be applied by the event loop
+  cfg_mqtt m_new_cfg;
+  std::string m_new_host, m_new_port;
+};
+
+static MqttHostClient *client;
+
+/// \brief send function for the offline publish queue
+static int send_queued(const char *topic, const char *data, size_t data_len, int qos, bool retain) {
+  return client ? client->publish(topic, data, data_len, qos, retain) : -1;
+}
+
+void Net_Mqtt::subscribe(const char *topic, int qos) {
+  if (!mqtt_subscriptions().add(topic, qos, client && client->is_connected()))
+    return;
+  const int msg_id = client->subscribe(topic, qos);
+  mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_SUBSCRIBE, msg_id, topic, strlen(topic), 0, qos);
+}
 
 void Net_Mqtt::unsubscribe(const char *topic) {
+  if (!mqtt_subscriptions().remove(topic, client && client->is_connected()))
+    return;
+  const int msg_id = client->unsubscribe(topic);
+  mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_UNSUBSCRIBE, msg_id, topic, strlen(topic));
+}
+
+/// \brief queue message while offline. Also if the queue is not yet drained, to keep the order of messages. \return see MqttPublishQueue::offer
+static int offer_to_queue(const mqtt_message &m) {
+  const int res = mqtt_publish_queue().offer(m, client->is_connected(), send_queued);
+  if (res <= 0)
+    mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_QUEUED, res, m.topic, strlen(m.topic), m.data_len, m.qos, m.retain);
+  return res;
 }
 
-void Net_Mqtt::publish(const char *topic, const char *data, bool retain) {
+int Net_Mqtt::publish_data(const char *topic, const void *data, size_t data_len, int qos, bool retain) {
+  if (!client)
+    return -1;
+
+  const mqtt_message m { topic, data, data_len, uint8_t(qos), retain };
+  if (int res = offer_to_queue(m); res <= 0)
+    return res;
+
+  const int msg_id = client->publish(topic, static_cast<const char*>(data), data_len, qos, retain);
+  mqtt_trace(MQTT_TRACE_INFO, MQTT_TEV_PUBLISH, msg_id, topic, strlen(topic), data_len, qos, retain);
+  if (msg_id < 0 && client->is_connected())
+    return -1; // output buffer full: the caller has to retry when the broker has caught up
+  if (msg_id < 0) // connection just lost
+    return offer_to_queue(m) == 0 ? 0 : -1;
+  return msg_id;
 }
 
-void io_mqtt_setup(struct cfg_mqtt *cfg_mqt) {
+int Net_Mqtt::publish_batch(const mqtt_message *msgs, size_t count) {
+  if (!client)
+    return 0;
+
+  if (client->is_connected() && mqtt_publish_queue().empty()) {
+    if (int res = client->publish_batch(msgs, count); res >= 0)
+      return res;
+    if (client->is_connected())
+      return 0; // output buffer full: the caller has to retry
+  }
+
+  int accepted = 0;
+  for (size_t i = 0; i < count; ++i)
+    accepted += offer_to_queue(msgs[i]) == 0;
+  return accepted;
 }
 
+void io_mqtt_setup(struct cfg_mqtt *c) {
+  if (c && c->enable) {
+    mqtt_topic_dispatch_setup(c->root_topic);
+    if (client && client->reconfigure(*c))
+      return; // keep client object and its event loop thread
+    delete client;
+    client = new MqttHostClient(*c);
+    if (!client->start()) {
+      fprintf(stderr, logtag ": setup: start client failed\n");
+      delete client;
+      client = nullptr;
+    }
+  } else {
+    delete client;
+    client = nullptr;
+  }
+}
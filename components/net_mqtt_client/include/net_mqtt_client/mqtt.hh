@@ -4,6 +4,7 @@
  */
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct cfg_mqtt {
@@ -17,6 +18,124 @@ struct cfg_mqtt {
 
 void io_mqtt_setup(struct cfg_mqtt *cfg_mqt);
 
+/// \brief MQTT message for \ref Net_Mqtt::publish_batch
+struct mqtt_message {
+  const char *topic; ///< null terminated TOPIC string
+  const void *data;  ///< CONTENT (not necessarily null terminated)
+  size_t data_len;   ///< length of DATA
+  uint8_t qos;       ///< quality of service (0..2)
+  bool retain;       ///< set retain flag
+};
+
+/// \brief statistics of the queue for messages published while not connected
+struct mqtt_queue_stats {
+  uint32_t queued;   ///< messages stored in queue
+  uint32_t dropped;  ///< messages lost because the queue was full (or non retained QoS 0 while offline)
+  uint32_t replaced; ///< retained messages replaced by a newer value for the same topic
+  uint32_t spilled;  ///< messages stored in spill file
+  uint32_t sent;     ///< queued messages sent after (re)connecting
+  uint16_t ram_count; ///< messages currently in RAM
+  uint32_t ram_bytes; ///< bytes currently used in RAM
+  uint32_t spill_bytes; ///< bytes currently used in spill file
+};
+
+/**
+ * \brief        Get statistics of the offline publish queue
+ * \param stats  destination
+ * \return       false if the queue is disabled
+ */
+bool io_mqtt_get_queue_stats(struct mqtt_queue_stats *stats);
+
+/// \brief statistics of reconnecting after the connection to the broker was lost
+struct mqtt_reconnect_stats {
+  uint32_t reconnects; ///< successful reconnects
+  uint32_t attempts;   ///< connection attempts after losing the connection (including failed ones)
+  uint32_t last_ms;    ///< time from losing the connection to CONNACK of the last reconnect
+  uint32_t max_ms;     ///< longest reconnect time
+  uint32_t avg_ms;     ///< average reconnect time
+};
+
+/**
+ * \brief        Get reconnect statistics
+ * \param stats  destination
+ * \return       true
+ */
+bool io_mqtt_get_reconnect_stats(struct mqtt_reconnect_stats *stats);
+
+/// \brief throughput and latency counters (see NET_MQTT_CLIENT_PERF_STATS)
+struct mqtt_perf_stats {
+  uint32_t published;      ///< messages handed to the client library
+  uint32_t acked;          ///< messages acknowledged by broker (QoS > 0)
+  uint32_t received;       ///< messages received
+  uint32_t received_bytes; ///< payload bytes received
+  uint32_t elapsed_ms;     ///< time since first message was published after reset
+  uint32_t latency_p50_us; ///< median publish to acknowledge latency (upper bound of power of two bucket)
+  uint32_t latency_p99_us; ///< 99th percentile publish to acknowledge latency (upper bound of power of two bucket)
+  uint32_t latency_max_us; ///< maximal publish to acknowledge latency
+};
+
+/**
+ * \brief        Get throughput and latency counters
+ * \param stats  destination
+ * \return       false if disabled by configuration
+ */
+bool io_mqtt_get_perf_stats(struct mqtt_perf_stats *stats);
+/// \brief reset counters of \ref io_mqtt_get_perf_stats (e.g. before a measurement)
+void io_mqtt_reset_perf_stats();
+
+/// \brief counters of the uout event bridge (see \ref io_mqtt_uout_bridge_setup)
+struct mqtt_bridge_stats {
+  uint32_t events;     ///< JSON events received from uout
+  uint32_t published;  ///< values published
+  uint32_t suppressed; ///< values not published because they did not change
+  uint32_t dropped;    ///< values the client failed to publish or queue
+};
+
+/**
+ * \brief        Mirror uout events to MQTT
+ *
+ *               Subscribes to the JSON format of the events selected by FLAGS. Each leaf value of an event is
+ *               published retained to a topic built from its keys under cfg_mqtt::root_topic (e.g.
+ *               {"pct":{"23":50}} publishes "50" to "<root_topic>/pct/23"). Values which did not change since they
+ *               were last published to a topic are suppressed.
+ *
+ * \param flags  events to mirror. The format flags are ignored. nullptr to stop mirroring
+ */
+void io_mqtt_uout_bridge_setup(const struct uo_flagsT *flags);
+
+/**
+ * \brief        Get counters of the uout event bridge
+ * \param stats  destination
+ * \return       true
+ */
+bool io_mqtt_get_bridge_stats(struct mqtt_bridge_stats *stats);
+
+/// \brief levels of trace records.  Records above the level set by \ref io_mqtt_trace_set_level are not recorded
+enum mqtt_trace_level : uint8_t {
+  MQTT_TRACE_OFF, MQTT_TRACE_INFO, MQTT_TRACE_DEBUG,
+};
+
+/**
+ * \brief        Set the level of the MQTT trace ring at runtime
+ * \param level  records of events with higher level are not recorded
+ */
+void io_mqtt_trace_set_level(enum mqtt_trace_level level);
+/// \brief get current trace level
+enum mqtt_trace_level io_mqtt_trace_get_level();
+
+/**
+ * \brief          Format trace records as text lines
+ *
+ *                 Records are stored in binary form by the client and only formatted here.
+ *                 Records overwritten since the last call are skipped.
+ *
+ * \param cursor   sequence number returned by the previous call (or 0 to read all records)
+ * \param line_cb  called for each formatted line (without newline)
+ * \param arg      passed to LINE_CB
+ * \return         cursor for the next call
+ */
+uint32_t io_mqtt_trace_read(uint32_t cursor, void (*line_cb)(const char *line, void *arg), void *arg);
+
 /// \brief test if TOPIC with TOPIC_LEN starts with string S
 bool topic_startsWith(const char *topic, int topic_len, const char *s);
 /// \brief test if TOPIC with TOPIC_LEN ends with string S
@@ -34,6 +153,38 @@ public:
   static Net_Mqtt& get_this() {
     return *ourDerivedObj;
   }
+
+  /// \brief handler for messages matching a topic filter. Parameters as in \ref received, plus ARG
+  using topic_handler = void (*)(const char *topic, int topic_len, const char *data, int data_len, void *arg);
+
+  /**
+   * \brief          Register a handler for received messages
+   *
+   *                 Handlers are called before \ref received. Registration is thread safe, but a handler must not
+   *                 register or clear handlers itself.
+   *
+   * \param filter   topic filter relative to cfg_mqtt::root_topic (e.g. "cli/+" matches "<root_topic>/cli/foo").
+   *                 May contain the wildcards '+' and '#'
+   * \param handler  called for each received message matching FILTER
+   * \param arg      passed to HANDLER
+   * \return         false if FILTER is invalid
+   */
+  static bool add_topic_handler(const char *filter, topic_handler handler, void *arg = nullptr);
+  /// \brief remove all handlers registered by \ref add_topic_handler
+  static void clear_topic_handlers();
+
+  /**
+   * \brief            Get a topic string prefixed by cfg_mqtt::root_topic, held once by the client
+   *
+   *                   Call this once and keep the returned pointer instead of building the topic for each publish.
+   *                   On MQTT 5 connections, publishing to a returned pointer uses a topic alias, so repeated
+   *                   publishes to the same topic send a 2-byte alias instead of the topic name.
+   *                   Call it again after the root topic was changed by io_mqtt_setup().
+   *
+   * \param rel_topic  topic relative to root topic (e.g. "status/temp")
+   * \return           null terminated topic (e.g. "root/status/temp"). Valid until program ends
+   */
+  static const char *intern_topic(const char *rel_topic);
 public:
   virtual ~Net_Mqtt() = default;
 
@@ -70,6 +221,22 @@ public:
   virtual void received(const char *topic, int topic_len, const char *data, int data_len) {
   }
 
+  /// \brief            event: part of a message too large for a single buffer of the client library has been received
+  ///
+  ///                   Override this to process large messages as a stream. If not handled, the fragments are
+  ///                   reassembled (up to NET_MQTT_CLIENT_REASSEMBLY_SIZE) and passed to \ref received.
+  ///
+  /// \param topic      non null terminated TOPIC string (of the message this fragment belongs to)
+  /// \param topic_len  length of TOPIC string
+  /// \param data       fragment of CONTENT
+  /// \param data_len   length of fragment
+  /// \param offset     offset of fragment in CONTENT
+  /// \param total_len  length of CONTENT
+  /// \return           true if the fragment was handled
+  virtual bool received_fragment(const char *topic, int topic_len, const char *data, int data_len, size_t offset, size_t total_len) {
+    return false;
+  }
+
 public:
   /// \brief        subscribe to TOPIC
   /// \param topic  null terminated TOPIC string
@@ -78,11 +245,39 @@ public:
   /// \brief        unsubscribe from TOPIC
   /// \param topic  null terminated TOPIC string
   virtual void unsubscribe(const char *topic);
-  /// \brief            publish MQTT message
+  /// \brief            publish MQTT message. If not connected, the message is queued and published after connecting
   /// \param topic      null terminated TOPIC string
   /// \param data       null terminated CONTENT string
   /// \param retain     Set retain flag in MQTT message
   virtual void publish(const char *topic, const char *data, bool retain = false);
+
+  /**
+   * \brief            publish MQTT message with explicit length and QoS
+   *
+   *                   If not connected, the message is queued and published after connecting. Non retained QoS 0
+   *                   messages are dropped instead. If connected but the client cannot take more data (the broker is
+   *                   slower than the publisher), the message is rejected with -1 and should be published again later.
+   *
+   * \param topic      null terminated TOPIC string
+   * \param data       CONTENT (may contain null bytes)
+   * \param data_len   length of DATA
+   * \param qos        quality of service (0..2).  QoS 0 messages are not acknowledged by \ref published
+   * \param retain     Set retain flag in MQTT message
+   * \return           message ID, 0 if QoS 0 or queued, -1 if dropped or rejected
+   */
+  int publish_data(const char *topic, const void *data, size_t data_len, int qos, bool retain = false);
+
+  /**
+   * \brief            publish many MQTT messages at once
+   *
+   *                   Messages are handed to the client library together, so they are sent with fewer socket writes.
+   *                   Messages are queued, dropped or rejected like in \ref publish_data.
+   *
+   * \param msgs       messages to publish
+   * \param count      number of messages in MSGS
+   * \return           number of messages sent or queued
+   */
+  int publish_batch(const mqtt_message *msgs, size_t count);
 private:
   static Net_Mqtt *ourDerivedObj;
 };
@@ -0,0 +1,171 @@
+/**
+ * \file    net_mqtt_client/topic_trie.hh
+ * \brief   Map MQTT topic filters to values using a trie of topic levels.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * \brief  Find all values whose topic filter matches a topic in O(topic levels * log(children per node))
+ *
+ *         The children of a node are kept sorted by level, so each level is found by binary search.
+ *         Filters may contain the MQTT wildcards '+' (exactly one level) and '#' (any number of levels, including
+ *         the parent level, must be the last level).  More than one value may be added for the same filter.
+ *
+ * \tparam value_type   type of values to store
+ */
+template<typename value_type>
+class TopicTrie {
+  struct Node {
+    std::string level;
+    std::vector<int16_t> children { }; ///< sorted by level
+    int16_t plus_child = -1;  ///< child for '+'
+    int16_t hash_child = -1;  ///< child for '#'
+    int16_t value_idx = -1;   ///< first value for filters ending at this node
+  };
+  struct Value {
+    value_type value;
+    int16_t next = -1; ///< next value of the same node
+  };
+
+public:
+  /**
+   * \brief         Add a topic filter
+   * \param filter  null terminated topic filter
+   * \param value   value to store for FILTER
+   * \return        false if FILTER is invalid or the trie is full
+   */
+  bool add(const char *filter, const value_type &value) {
+    if (m_nodes.empty())
+      m_nodes.push_back(Node { });
+
+    int node = 0;
+    for (const char *p = filter;;) {
+      const char *end = p;
+      while (*end && *end != '/')
+        ++end;
+      const std::string_view level(p, end - p);
+
+      if (level == "#" && *end)
+        return false; // '#' must be last level
+      if (level.size() > 1 && level.find_first_of("+#") != level.npos)
+        return false; // wildcards must occupy a whole level
+
+      if ((node = get_child(node, level, true)) < 0)
+        return false;
+      if (!*end)
+        break;
+      p = end + 1;
+    }
+
+    if (m_values.size() >= INT16_MAX)
+      return false;
+    Value v { value, m_nodes[node].value_idx };
+    m_nodes[node].value_idx = m_values.size();
+    m_values.push_back(v);
+    return true;
+  }
+
+  /**
+   * \brief            Call FN for each value whose filter matches TOPIC
+   * \param topic      topic (not necessarily null terminated)
+   * \param topic_len  length of TOPIC
+   * \param fn         called with (const value_type &)
+   * \return           number of matching values
+   */
+  template<typename Fn>
+  int for_each_match(const char *topic, size_t topic_len, Fn &&fn) const {
+    if (m_nodes.empty())
+      return 0;
+    return match(0, topic, topic + topic_len, fn);
+  }
+
+  /// \brief remove all filters
+  void clear() {
+    m_nodes.clear();
+    m_values.clear();
+  }
+
+  /// \brief test if no filter was added
+  bool empty() const {
+    return m_values.empty();
+  }
+
+private:
+  template<typename Fn>
+  int call_values(int node, Fn &fn) const {
+    int count = 0;
+    for (int i = m_nodes[node].value_idx; i >= 0; i = m_values[i].next, ++count)
+      fn(m_values[i].value);
+    return count;
+  }
+
+  template<typename Fn>
+  int match(int node, const char *p, const char *topic_end, Fn &fn) const {
+    const char *end = p;
+    while (end < topic_end && *end != '/')
+      ++end;
+    const std::string_view level(p, end - p);
+    const bool last = end == topic_end;
+    int count = 0;
+
+    // "a/#" matches "a" too
+    if (int hash = m_nodes[node].hash_child; hash >= 0)
+      count += call_values(hash, fn);
+
+    for (int child : { get_child(node, level), int(m_nodes[node].plus_child) }) {
+      if (child < 0)
+        continue;
+      if (last) {
+        count += call_values(child, fn);
+        if (int hash = m_nodes[child].hash_child; hash >= 0)
+          count += call_values(hash, fn);
+      } else {
+        count += match(child, end + 1, topic_end, fn);
+      }
+    }
+    return count;
+  }
+
+  /// \brief \return iterator to the first child of NODE whose level is not less than LEVEL
+  std::vector<int16_t>::const_iterator lower_bound(int node, std::string_view level) const {
+    const auto &children = m_nodes[node].children;
+    return std::lower_bound(children.begin(), children.end(), level, [this](int16_t child, std::string_view key) {
+      return std::string_view(m_nodes[child].level) < key;
+    });
+  }
+
+  int get_child(int node, std::string_view level) const {
+    const auto it = lower_bound(node, level);
+    return it != m_nodes[node].children.end() && m_nodes[*it].level == level ? *it : -1;
+  }
+
+  int get_child(int node, std::string_view level, bool create) {
+    const bool plus = level == "+", hash = level == "#";
+    if (int child = plus ? m_nodes[node].plus_child : hash ? m_nodes[node].hash_child : get_child(node, level); child >= 0 || !create)
+      return child;
+    if (m_nodes.size() >= INT16_MAX)
+      return -1;
+
+    const int16_t child = m_nodes.size();
+    const size_t pos = lower_bound(node, level) - m_nodes[node].children.begin(); // before push_back invalidates iterators
+    m_nodes.push_back(Node { std::string(level) });
+    if (plus)
+      m_nodes[node].plus_child = child;
+    else if (hash)
+      m_nodes[node].hash_child = child;
+    else
+      m_nodes[node].children.insert(m_nodes[node].children.begin() + pos, child);
+    return child;
+  }
+
+private:
+  std::vector<Node> m_nodes;
+  std::vector<Value> m_values;
+};
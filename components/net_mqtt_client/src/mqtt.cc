@@ -26,4 +26,8 @@ void Net_Mqtt::setup(Net_Mqtt *derived_obj) {
   ourDerivedObj = derived_obj ? derived_obj : &My_base_obj;
 }
 
+void Net_Mqtt::publish(const char *topic, const char *data, bool retain) {
+  publish_data(topic, data, strlen(data), 1, retain);
+}
+
 
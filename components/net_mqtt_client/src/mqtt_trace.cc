@@ -0,0 +1,124 @@
+#include "mqtt_trace.hh"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef CONFIG_NET_MQTT_CLIENT_TRACE_SIZE
+#define CONFIG_NET_MQTT_CLIENT_TRACE_SIZE 0
+#endif
+#ifndef CONFIG_NET_MQTT_CLIENT_TRACE_LEVEL
+#define CONFIG_NET_MQTT_CLIENT_TRACE_LEVEL 1
+#endif
+
+#define TOPIC_TAIL 24 ///< number of topic characters stored per record
+
+std::atomic<uint8_t> mqtt_trace_threshold { CONFIG_NET_MQTT_CLIENT_TRACE_LEVEL };
+
+#if CONFIG_NET_MQTT_CLIENT_TRACE_SIZE > 0
+/// \brief records are written without locking. Readers detect torn records by checking SEQ before and after copying
+struct trace_record {
+  std::atomic<uint32_t> seq; ///< sequence number + 1 if complete, 0 while being written
+  uint32_t time_ms;
+  int32_t msg_id;
+  uint32_t data_len;
+  mqtt_trace_event ev;
+  uint8_t qos :2, retain :1;
+  uint8_t topic_len;   ///< original topic length (saturated)
+  char topic[TOPIC_TAIL]; ///< last characters of topic
+};
+
+static trace_record ring[CONFIG_NET_MQTT_CLIENT_TRACE_SIZE];
+static std::atomic<uint32_t> head;
+
+static uint32_t time_ms() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void mqtt_trace_put(mqtt_trace_event ev, int msg_id, const char *topic, size_t topic_len, size_t data_len, int qos, bool retain) {
+  const uint32_t seq = head.fetch_add(1, std::memory_order_relaxed);
+  trace_record &r = ring[seq % CONFIG_NET_MQTT_CLIENT_TRACE_SIZE];
+
+  r.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  r.time_ms = time_ms();
+  r.msg_id = msg_id;
+  r.data_len = data_len;
+  r.ev = ev;
+  r.qos = qos;
+  r.retain = retain;
+  r.topic_len = topic_len > 255 ? 255 : topic_len;
+  if (topic) {
+    const size_t n = topic_len > TOPIC_TAIL ? TOPIC_TAIL : topic_len;
+    memcpy(r.topic, topic + topic_len - n, n);
+  }
+  r.seq.store(seq + 1, std::memory_order_release);
+}
+
+static const char *const ev_names[] = { "publish", "published", "received", "subscribe", "subscribed", "unsubscribe", "unsubscribed",
+    "queued", };
+
+static void format(char *buf, size_t buf_size, const trace_record &r) {
+  const int n = r.topic_len > TOPIC_TAIL ? TOPIC_TAIL : r.topic_len;
+  const char *ellipsis = r.topic_len > TOPIC_TAIL ? "..." : "";
+  const char *name = r.ev < sizeof ev_names / sizeof ev_names[0] ? ev_names[r.ev] : "?";
+
+  switch (r.ev) {
+  case MQTT_TEV_PUBLISH:
+  case MQTT_TEV_QUEUED:
+    snprintf(buf, buf_size, "%u.%03u %s: msg_id=%d, TOPIC=<%s%.*s>, DATA_LEN=%u, QOS=%u, RET=%u", unsigned(r.time_ms / 1000),
+        unsigned(r.time_ms % 1000), name, int(r.msg_id), ellipsis, n, r.topic, unsigned(r.data_len), unsigned(r.qos), unsigned(r.retain));
+    break;
+  case MQTT_TEV_RECEIVED:
+    snprintf(buf, buf_size, "%u.%03u %s: TOPIC=<%s%.*s>, DATA_LEN=%u", unsigned(r.time_ms / 1000), unsigned(r.time_ms % 1000), name,
+        ellipsis, n, r.topic, unsigned(r.data_len));
+    break;
+  case MQTT_TEV_SUBSCRIBE:
+  case MQTT_TEV_UNSUBSCRIBE:
+    snprintf(buf, buf_size, "%u.%03u %s: msg_id=%d, TOPIC=<%s%.*s>, QOS=%u", unsigned(r.time_ms / 1000), unsigned(r.time_ms % 1000),
+        name, int(r.msg_id), ellipsis, n, r.topic, unsigned(r.qos));
+    break;
+  default:
+    snprintf(buf, buf_size, "%u.%03u %s: msg_id=%d", unsigned(r.time_ms / 1000), unsigned(r.time_ms % 1000), name, int(r.msg_id));
+    break;
+  }
+}
+
+uint32_t io_mqtt_trace_read(uint32_t cursor, void (*line_cb)(const char *line, void *arg), void *arg) {
+  const uint32_t end = head.load(std::memory_order_acquire);
+  uint32_t seq = cursor;
+  if (end - seq > CONFIG_NET_MQTT_CLIENT_TRACE_SIZE)
+    seq = end - CONFIG_NET_MQTT_CLIENT_TRACE_SIZE; // older records are overwritten
+
+  for (; seq != end; ++seq) {
+    const trace_record &r = ring[seq % CONFIG_NET_MQTT_CLIENT_TRACE_SIZE];
+    const uint32_t s1 = r.seq.load(std::memory_order_acquire);
+    if (s1 == 0 || int32_t(s1 - (seq + 1)) < 0)
+      break; // still being written. Read it next time
+
+    char buf[128];
+    format(buf, sizeof buf, r);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s1 != seq + 1 || r.seq.load(std::memory_order_relaxed) != s1)
+      continue; // overwritten by a newer record
+    line_cb(buf, arg);
+  }
+  return seq;
+}
+
+#else
+void mqtt_trace_put(mqtt_trace_event ev, int msg_id, const char *topic, size_t topic_len, size_t data_len, int qos, bool retain) {
+}
+uint32_t io_mqtt_trace_read(uint32_t cursor, void (*line_cb)(const char *line, void *arg), void *arg) {
+  return cursor;
+}
+#endif
+
+void io_mqtt_trace_set_level(enum mqtt_trace_level level) {
+  mqtt_trace_threshold.store(level, std::memory_order_relaxed);
+}
+
+enum mqtt_trace_level io_mqtt_trace_get_level() {
+  return mqtt_trace_level(mqtt_trace_threshold.load(std::memory_order_relaxed));
+}
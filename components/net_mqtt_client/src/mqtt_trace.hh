@@ -0,0 +1,36 @@
+/**
+ * \file   mqtt_trace.hh
+ * \brief  Ring of binary trace records for the MQTT client hot path
+ */
+#pragma once
+
+#include "net_mqtt_client/mqtt.hh"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/// \brief traced events
+enum mqtt_trace_event : uint8_t {
+  MQTT_TEV_PUBLISH, MQTT_TEV_PUBLISHED, MQTT_TEV_RECEIVED, MQTT_TEV_SUBSCRIBE, MQTT_TEV_SUBSCRIBED, MQTT_TEV_UNSUBSCRIBE,
+  MQTT_TEV_UNSUBSCRIBED, MQTT_TEV_QUEUED,
+};
+
+extern std::atomic<uint8_t> mqtt_trace_threshold;
+
+/**
+ * \brief            Store a trace record (without formatting)
+ * \param topic      topic or nullptr. Only the last characters are kept
+ * \param topic_len  length of TOPIC
+ */
+void mqtt_trace_put(mqtt_trace_event ev, int msg_id, const char *topic, size_t topic_len, size_t data_len, int qos, bool retain);
+
+/// \brief record event EV if LEVEL is enabled
+inline void mqtt_trace(mqtt_trace_level level, mqtt_trace_event ev, int msg_id, const char *topic = nullptr, size_t topic_len = 0,
+    size_t data_len = 0, int qos = 0, bool retain = false) {
+#if CONFIG_NET_MQTT_CLIENT_TRACE_SIZE > 0
+  if (level > mqtt_trace_threshold.load(std::memory_order_relaxed))
+    return;
+  mqtt_trace_put(ev, msg_id, topic, topic_len, data_len, qos, retain);
+#endif
+}
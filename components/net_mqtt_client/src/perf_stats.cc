@@ -0,0 +1,103 @@
+#include "perf_stats.hh"
+
+#include <string.h>
+#include <chrono>
+#include <mutex>
+
+#ifdef CONFIG_NET_MQTT_CLIENT_PERF_STATS
+
+#define IN_FLIGHT_SLOTS 64 ///< messages waiting for acknowledge which are timed. Others are not counted for latency
+#define LATENCY_BUCKETS 32 ///< bucket N holds latencies < 2^N us
+
+static std::mutex perf_mutex;
+static struct {
+  uint16_t msg_id;
+  uint32_t sent_us;
+} in_flight[IN_FLIGHT_SLOTS];
+static uint32_t latency_hist[LATENCY_BUCKETS];
+static uint32_t latency_max_us;
+static mqtt_perf_stats counters;
+static uint64_t start_us;
+
+static uint64_t us_now() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void mqtt_perf_sent(int msg_id) {
+  const uint64_t now = us_now();
+  std::lock_guard<std::mutex> lock(perf_mutex);
+  if (!start_us)
+    start_us = now;
+  ++counters.published;
+  if (msg_id > 0)
+    in_flight[msg_id % IN_FLIGHT_SLOTS] = { uint16_t(msg_id), uint32_t(now) };
+}
+
+void mqtt_perf_acked(int msg_id) {
+  const uint32_t now = us_now();
+  std::lock_guard<std::mutex> lock(perf_mutex);
+  ++counters.acked;
+  auto &slot = in_flight[msg_id % IN_FLIGHT_SLOTS];
+  if (msg_id <= 0 || slot.msg_id != msg_id)
+    return;
+  slot.msg_id = 0;
+
+  const uint32_t us = now - slot.sent_us;
+  unsigned bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && (uint32_t(1) << bucket) <= us)
+    ++bucket;
+  ++latency_hist[bucket];
+  if (us > latency_max_us)
+    latency_max_us = us;
+}
+
+void mqtt_perf_received(int data_len) {
+  std::lock_guard<std::mutex> lock(perf_mutex);
+  ++counters.received;
+  counters.received_bytes += data_len;
+}
+
+/// \brief upper bound of the bucket containing the given percentile
+static uint32_t percentile_us(uint32_t count, unsigned percent) {
+  const uint32_t rank = (uint64_t(count) * percent + 99) / 100;
+  uint32_t sum = 0;
+  for (unsigned i = 0; i < LATENCY_BUCKETS; ++i) {
+    if ((sum += latency_hist[i]) >= rank && rank)
+      return uint32_t(1) << i;
+  }
+  return 0;
+}
+
+bool io_mqtt_get_perf_stats(struct mqtt_perf_stats *stats) {
+  const uint64_t now = us_now();
+  std::lock_guard<std::mutex> lock(perf_mutex);
+  *stats = counters;
+  uint32_t timed = 0;
+  for (auto n : latency_hist)
+    timed += n;
+  stats->latency_p50_us = percentile_us(timed, 50);
+  stats->latency_p99_us = percentile_us(timed, 99);
+  stats->latency_max_us = latency_max_us;
+  stats->elapsed_ms = start_us ? (now - start_us) / 1000 : 0;
+  return true;
+}
+
+void io_mqtt_reset_perf_stats() {
+  std::lock_guard<std::mutex> lock(perf_mutex);
+  memset(in_flight, 0, sizeof in_flight);
+  memset(latency_hist, 0, sizeof latency_hist);
+  latency_max_us = 0;
+  counters = { };
+  start_us = 0;
+}
+
+#else
+bool io_mqtt_get_perf_stats(struct mqtt_perf_stats *stats) {
+  *stats = { };
+  return false;
+}
+
+void io_mqtt_reset_perf_stats() {
+}
+#endif
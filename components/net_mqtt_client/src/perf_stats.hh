@@ -0,0 +1,23 @@
+/**
+ * \file   perf_stats.hh
+ * \brief  Throughput and publish-to-acknowledge latency counters of the MQTT client
+ */
+#pragma once
+
+#include "net_mqtt_client/mqtt.hh"
+
+#ifdef CONFIG_NET_MQTT_CLIENT_PERF_STATS
+/// \brief message with ID MSG_ID (0 for QoS 0) has been handed to the client library
+void mqtt_perf_sent(int msg_id);
+/// \brief message with ID MSG_ID has been acknowledged
+void mqtt_perf_acked(int msg_id);
+/// \brief message received
+void mqtt_perf_received(int data_len);
+#else
+inline void mqtt_perf_sent(int msg_id) {
+}
+inline void mqtt_perf_acked(int msg_id) {
+}
+inline void mqtt_perf_received(int data_len) {
+}
+#endif
@@ -0,0 +1,272 @@
+#include "publish_queue.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef CONFIG_NET_MQTT_CLIENT_DEBUG
+#define DEBUG
+#define D(x) x
+#else
+#define D(x)
+#endif
+#define logtag "mqtt_client"
+
+#define SPILL_HDR_SIZE 7 ///< u16 topic length, u32 data length, u8 flags
+#define QOS0_SLOT_MS 20 ///< a sent QoS 0 message occupies its window slot this long, to pace a QoS 0 backlog
+
+bool MqttPublishQueue::push(const char *topic, const char *data, size_t data_len, int qos, bool retain, bool evict) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  // retained: only the latest value matters. If the topic was spilled, the new value goes to the file too
+  if (retain && !m_spilled_retained.count(topic)) {
+    for (auto &msg : m_ram) {
+      if (msg.retain && msg.topic == topic) {
+        m_ram_used -= msg.size();
+        msg.data.assign(data, data_len);
+        msg.qos = qos;
+        m_ram_used += msg.size();
+        ++m_replaced;
+        return true;
+      }
+    }
+  }
+
+  message msg { topic, std::string(data, data_len), uint8_t(qos), retain };
+
+  // keep order: if spilling has started, newer messages go to the file too
+  if (spilling() || m_ram_used + msg.size() > m_ram_size) {
+    if (m_spill_file && *m_spill_file) {
+      ++m_spill_writers;
+      lock.unlock(); // don't block publishers and drain() while writing the file
+      std::lock_guard<std::mutex> file_lock(m_file_mutex);
+      const long pos = m_spill_write_pos;
+      const long rec_size = spill(msg);
+      lock.lock();
+      --m_spill_writers;
+      if (rec_size < 0) {
+        ++m_dropped;
+        return false;
+      }
+      m_spill_write_pos += rec_size;
+      if (retain) {
+        auto res = m_spilled_retained.insert_or_assign(msg.topic, pos);
+        m_replaced += !res.second; // older record is skipped when read back
+      }
+      ++m_queued;
+      ++m_spilled;
+      return true;
+    }
+    if (!evict)
+      return false; // caller keeps the message and may retry
+    if (msg.size() > m_ram_size) {
+      ++m_dropped;
+      return false;
+    }
+    while (m_ram_used + msg.size() > m_ram_size) {
+      m_ram_used -= m_ram.front().size();
+      m_ram.pop_front();
+      ++m_dropped;
+    }
+  }
+
+  ++m_queued;
+  m_ram_used += msg.size();
+  m_ram.push_back(std::move(msg));
+  return true;
+}
+
+int MqttPublishQueue::offer(const mqtt_message &msg, bool connected, send_fn send) {
+  if (connected && empty())
+    return 1;
+
+  if (!connected && !msg.qos && !msg.retain) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_dropped; // QoS 0 is "at most once": old telemetry is not worth queuing
+    return -1;
+  }
+
+  const bool ok = push(msg.topic, static_cast<const char*>(msg.data), msg.data_len, msg.qos, msg.retain, !connected);
+  if (connected)
+    drain(send);
+  return ok ? 0 : -1;
+}
+
+long MqttPublishQueue::spill(const message &msg) {
+  const size_t rec_size = SPILL_HDR_SIZE + msg.topic.size() + msg.data.size();
+  if (m_spill_write_pos + rec_size > m_spill_size || msg.topic.size() > 0xffff)
+    return -1;
+
+  FILE *fp = fopen(m_spill_file, m_spill_write_pos ? "ab" : "wb");
+  if (!fp)
+    return -1;
+
+  const uint32_t topic_len = msg.topic.size(), data_len = msg.data.size();
+  const uint8_t hdr[SPILL_HDR_SIZE] = { uint8_t(topic_len >> 8), uint8_t(topic_len), uint8_t(data_len >> 24), uint8_t(data_len >> 16), uint8_t(data_len >> 8),
+      uint8_t(data_len), uint8_t(msg.qos | (msg.retain ? 4 : 0)) };
+  const bool ok = fwrite(hdr, sizeof hdr, 1, fp) == 1 && fwrite(msg.topic.data(), 1, topic_len, fp) == topic_len
+      && fwrite(msg.data.data(), 1, data_len, fp) == data_len;
+  if (fclose(fp) != 0 || !ok)
+    return -1;
+
+  return rec_size;
+}
+
+long MqttPublishQueue::unspill(message &msg) {
+  long rec_size = -1;
+  if (FILE *fp = fopen(m_spill_file, "rb")) {
+    uint8_t hdr[SPILL_HDR_SIZE];
+    if (fseek(fp, m_spill_read_pos, SEEK_SET) == 0 && fread(hdr, sizeof hdr, 1, fp) == 1) {
+      const uint32_t topic_len = hdr[0] << 8 | hdr[1];
+      const uint32_t data_len = uint32_t(hdr[2]) << 24 | hdr[3] << 16 | hdr[4] << 8 | hdr[5];
+      msg.topic.resize(topic_len);
+      msg.data.resize(data_len);
+      msg.qos = hdr[6] & 3;
+      msg.retain = hdr[6] & 4;
+      if (fread(&msg.topic[0], 1, topic_len, fp) == topic_len && fread(&msg.data[0], 1, data_len, fp) == data_len)
+        rec_size = SPILL_HDR_SIZE + topic_len + data_len;
+    }
+    fclose(fp);
+  }
+  return rec_size;
+}
+
+bool MqttPublishQueue::pop(message &msg, std::unique_lock<std::mutex> &lock) {
+  if (!m_ram.empty()) {
+    msg = std::move(m_ram.front());
+    m_ram.pop_front();
+    m_ram_used -= msg.size();
+    return true;
+  }
+
+  // RAM stays empty while records are in the file, so the order is kept while we read without holding LOCK
+  while (m_spill_read_pos < m_spill_write_pos) {
+    lock.unlock();
+    std::lock_guard<std::mutex> file_lock(m_file_mutex);
+    const long pos = m_spill_read_pos;
+    const long rec_size = unspill(msg);
+    lock.lock();
+
+    if (rec_size < 0) {
+      fprintf(stderr, logtag ": cannot read spill file <%s>. Discard it\n", m_spill_file);
+      m_spill_read_pos = m_spill_write_pos;
+    } else {
+      m_spill_read_pos += rec_size;
+    }
+    bool superseded = false;
+    if (rec_size >= 0 && msg.retain) {
+      if (auto it = m_spilled_retained.find(msg.topic); it != m_spilled_retained.end() && it->second == pos)
+        m_spilled_retained.erase(it);
+      else
+        superseded = true; // a newer value was spilled later
+    }
+    if (m_spill_read_pos >= m_spill_write_pos) {
+      remove(m_spill_file); // no writer can be active: we hold m_file_mutex
+      m_spill_read_pos = m_spill_write_pos = 0;
+      m_spilled_retained.clear();
+    }
+    if (rec_size < 0)
+      return false;
+    if (!superseded)
+      return true;
+  }
+  return false;
+}
+
+/// \brief monotonic time in ms
+static uint64_t ms_now() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MqttPublishQueue::drain(send_fn send) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_draining)
+    return;
+  m_draining = true;
+
+  const unsigned slots = std::min(m_window_size, unsigned(sizeof m_in_flight / sizeof m_in_flight[0]));
+  for (;;) {
+    const uint64_t now = ms_now();
+    unsigned slot = slots;
+    for (unsigned i = 0; i < slots; ++i) {
+      if (m_in_flight[i] < 0 || (m_in_flight[i] == 0 && m_slot_free_ms[i] <= now)) {
+        slot = i;
+        break;
+      }
+    }
+    message msg;
+    if (slot == slots || !pop(msg, lock))
+      break;
+
+    m_in_flight[slot] = 0; // reserved
+    m_slot_free_ms[slot] = UINT64_MAX;
+    lock.unlock(); // don't hold our lock while calling the client library
+    const int msg_id = send(msg.topic.c_str(), msg.data.data(), msg.data.size(), msg.qos, msg.retain);
+    lock.lock();
+
+    if (msg_id < 0) {
+      m_in_flight[slot] = -1;
+      m_ram_used += msg.size();
+      m_ram.push_front(std::move(msg));
+      break;
+    }
+    ++m_sent;
+    m_in_flight[slot] = msg_id;
+    m_slot_free_ms[slot] = ms_now() + QOS0_SLOT_MS; // QoS 0 has no PUBLISHED event
+  }
+  m_draining = false;
+}
+
+unsigned MqttPublishQueue::next_drain_ms() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_ram.empty() && !spilling())
+    return 0;
+
+  const uint64_t now = ms_now();
+  uint64_t next = UINT64_MAX;
+  for (unsigned i = 0; i < m_window_size && i < sizeof m_in_flight / sizeof m_in_flight[0]; ++i) {
+    if (m_in_flight[i] == 0 && m_slot_free_ms[i] != UINT64_MAX)
+      next = std::min(next, m_slot_free_ms[i]);
+  }
+  if (next == UINT64_MAX)
+    return 0; // window is free or waits for PUBLISHED events
+  return next > now ? unsigned(next - now) : 1;
+}
+
+void MqttPublishQueue::published(int msg_id) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &id : m_in_flight) {
+    if (id == msg_id)
+      id = -1;
+  }
+}
+
+void MqttPublishQueue::disconnected() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &id : m_in_flight)
+    id = -1;
+}
+
+bool MqttPublishQueue::empty() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_ram.empty() && !spilling();
+}
+
+void MqttPublishQueue::get_stats(struct mqtt_queue_stats *stats) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  *stats = mqtt_queue_stats { m_queued, m_dropped, m_replaced, m_spilled, m_sent, uint16_t(m_ram.size()), uint32_t(m_ram_used), uint32_t(
+      m_spill_write_pos - m_spill_read_pos) };
+}
+
+MqttPublishQueue& mqtt_publish_queue() {
+  static MqttPublishQueue queue(CONFIG_NET_MQTT_CLIENT_QUEUE_SIZE, CONFIG_NET_MQTT_CLIENT_QUEUE_WINDOW, CONFIG_NET_MQTT_CLIENT_QUEUE_SPILL_FILE,
+      CONFIG_NET_MQTT_CLIENT_QUEUE_SPILL_SIZE);
+  return queue;
+}
+
+bool io_mqtt_get_queue_stats(struct mqtt_queue_stats *stats) {
+  mqtt_publish_queue().get_stats(stats);
+  return CONFIG_NET_MQTT_CLIENT_QUEUE_SIZE > 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * \file   publish_queue.hh
+ * \brief  Store and forward queue for MQTT messages published while not connected
+ */
+#pragma once
+
+#include "net_mqtt_client/mqtt.hh"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * \brief  Bounded queue of messages waiting to be published
+ *
+ *         Messages are kept in RAM up to a byte budget.  If full, messages are spilled to a file (if configured) or the
+ *         oldest messages are dropped.  For retained messages only the latest value per topic is kept, in RAM and in
+ *         the spill file.  The file is accessed without holding the lock used by publishers.
+ *
+ *         The queue is drained after connecting, with at most window_size messages in flight.  A QoS>0 message leaves
+ *         the window with its PUBLISHED event, a QoS 0 message after QOS0_SLOT_MS.  The client has to call drain()
+ *         again after next_drain_ms().
+ */
+class MqttPublishQueue {
+public:
+  /// \brief         sends a message. \return message ID (0 for QoS 0) or -1 on error
+  using send_fn = int (*)(const char *topic, const char *data, size_t data_len, int qos, bool retain);
+
+  MqttPublishQueue(size_t ram_size, unsigned window_size, const char *spill_file, size_t spill_size) :
+      m_ram_size(ram_size), m_window_size(window_size), m_spill_file(spill_file), m_spill_size(spill_size) {
+  }
+
+  /**
+   * \brief          queue a message
+   * \param evict    if full, drop the oldest messages to make room. If false, the new message is rejected instead
+   * \return         false if the message was dropped or rejected
+   */
+  bool push(const char *topic, const char *data, size_t data_len, int qos, bool retain, bool evict = true);
+
+  /**
+   * \brief            queue a message if not connected or if older messages are still queued
+   * \param connected  client is connected.  If not, non retained QoS 0 messages are dropped. If connected, queued
+   *                  messages are never evicted; a message which does not fit is rejected instead
+   * \param send       used to drain the queue if connected
+   * \return           0 if queued, -1 if dropped or rejected, 1 if not queued (caller has to send the message)
+   */
+  int offer(const mqtt_message &msg, bool connected, send_fn send);
+
+  /// \brief send queued messages until the window is full or the queue is empty
+  void drain(send_fn send);
+
+  /// \brief \return milliseconds until drain() can send more messages because a QoS 0 slot of the window frees up, or 0 if no timer is needed
+  unsigned next_drain_ms();
+
+  /// \brief a message has been acknowledged by the broker
+  void published(int msg_id);
+
+  /// \brief connection is lost. Messages in flight are the client library's business now
+  void disconnected();
+
+  /// \brief test if queue is empty (including spill file)
+  bool empty();
+
+  /// \brief copy statistics
+  void get_stats(struct mqtt_queue_stats *stats);
+
+private:
+  struct message {
+    std::string topic;
+    std::string data;
+    uint8_t qos;
+    bool retain;
+    size_t size() const {
+      return topic.size() + data.size() + sizeof(message);
+    }
+  };
+
+  bool spilling() const {
+    return m_spill_writers || m_spill_write_pos > m_spill_read_pos;
+  }
+  long spill(const message &msg);
+  long unspill(message &msg);
+  bool pop(message &msg, std::unique_lock<std::mutex> &lock);
+
+private:
+  std::mutex m_mutex;
+  std::mutex m_file_mutex; ///< serializes access to the spill file. Taken before m_mutex, never while holding it
+  std::deque<message> m_ram;
+  size_t m_ram_used = 0;
+  size_t m_ram_size;
+  unsigned m_window_size;
+  int m_in_flight[8] = { -1, -1, -1, -1, -1, -1, -1, -1 }; ///< message IDs waiting for PUBLISHED, 0 while sending or for QoS 0
+  uint64_t m_slot_free_ms[8] = { }; ///< time a QoS 0 slot becomes free
+  const char *m_spill_file;
+  size_t m_spill_size;
+  long m_spill_read_pos = 0;
+  long m_spill_write_pos = 0; ///< changed only while holding both locks
+  unsigned m_spill_writers = 0; ///< pushes waiting to write to the spill file
+  std::unordered_map<std::string, long> m_spilled_retained; ///< position of the latest spilled record per retained topic
+  bool m_draining = false;
+  uint32_t m_queued = 0, m_dropped = 0, m_replaced = 0, m_spilled = 0, m_sent = 0;
+};
+
+/// \brief the queue used by Net_Mqtt::publish
+MqttPublishQueue& mqtt_publish_queue();
@@ -0,0 +1,48 @@
+#include "reassembly.hh"
+#include "net_mqtt_client/mqtt.hh"
+
+#include <string.h>
+
+#ifndef CONFIG_NET_MQTT_CLIENT_REASSEMBLY_SIZE
+#define CONFIG_NET_MQTT_CLIENT_REASSEMBLY_SIZE 0
+#endif
+
+void MqttReassembly::reserve() {
+  if (!m_buf && m_buf_size)
+    m_buf.reset(new char[m_buf_size]);
+}
+
+MqttReassembly::result MqttReassembly::fragment(const char *topic, int topic_len, const char *data, int data_len, size_t offset, size_t total_len,
+    deliver_fn deliver) {
+  if (offset == 0) {
+    m_topic.assign(topic, topic_len);
+    m_total_len = total_len;
+    m_received = 0;
+    m_discard = !m_buf || total_len > m_buf_size;
+  } else if (total_len != m_total_len || offset != m_received) {
+    return IGNORED; // lost the start of this message
+  }
+  if (offset + data_len > total_len)
+    return IGNORED;
+
+  const bool last = offset + data_len >= total_len;
+  m_received = offset + data_len;
+  if (Net_Mqtt::get_this().received_fragment(m_topic.data(), m_topic.size(), data, data_len, offset, total_len)) {
+    m_discard = true;
+    return STREAMED;
+  }
+  if (m_discard)
+    return offset == 0 ? TOO_LARGE : IGNORED;
+
+  memcpy(m_buf.get() + offset, data, data_len);
+  if (!last)
+    return PENDING;
+
+  deliver(m_topic.data(), m_topic.size(), m_buf.get(), total_len);
+  return DELIVERED;
+}
+
+MqttReassembly& mqtt_reassembly() {
+  static MqttReassembly reassembly(CONFIG_NET_MQTT_CLIENT_REASSEMBLY_SIZE);
+  return reassembly;
+}
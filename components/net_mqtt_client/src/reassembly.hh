@@ -0,0 +1,58 @@
+/**
+ * \file   reassembly.hh
+ * \brief  Reassemble MQTT messages delivered in fragments by the client library
+ */
+#pragma once
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+
+/**
+ * \brief  Collect the fragments of a received message in a preallocated buffer
+ *
+ *         Fragments arrive in order and one message at a time (from the client library's task).
+ *         Only the first fragment carries the topic.  Each fragment is offered to Net_Mqtt::received_fragment first.
+ *         If that handles it, the message is not reassembled.
+ */
+class MqttReassembly {
+public:
+  /// \brief called with a complete message
+  using deliver_fn = void (*)(const char *topic, int topic_len, const char *data, int data_len);
+
+  /// \brief result of \ref fragment
+  enum result {
+    PENDING,   ///< stored, message not complete yet
+    STREAMED,  ///< handled by Net_Mqtt::received_fragment
+    DELIVERED, ///< message complete and delivered
+    TOO_LARGE, ///< message does not fit into buffer. Its fragments are ignored
+    IGNORED,   ///< fragment does not belong to a message being reassembled
+  };
+
+  explicit MqttReassembly(size_t buf_size) :
+      m_buf_size(buf_size) {
+  }
+
+  /// \brief allocate buffer (if not done yet)
+  void reserve();
+
+  /**
+   * \brief            store a fragment
+   * \param topic      topic (first fragment only, may be empty for others)
+   * \param offset     offset of DATA in message
+   * \param total_len  length of complete message
+   * \param deliver    called if the message is complete
+   */
+  result fragment(const char *topic, int topic_len, const char *data, int data_len, size_t offset, size_t total_len, deliver_fn deliver);
+
+private:
+  std::unique_ptr<char[]> m_buf;
+  size_t m_buf_size;
+  std::string m_topic;
+  size_t m_total_len = 0;
+  size_t m_received = 0;
+  bool m_discard = false; ///< ignore the remaining fragments of the current message
+};
+
+/// \brief the reassembly buffer used by the client
+MqttReassembly& mqtt_reassembly();
@@ -0,0 +1,74 @@
+#include "reconnect.hh"
+
+#include <functional>
+#include <string_view>
+
+#ifndef CONFIG_NET_MQTT_CLIENT_RECONNECT_FIRST_MS
+#define CONFIG_NET_MQTT_CLIENT_RECONNECT_FIRST_MS 500
+#endif
+#ifndef CONFIG_NET_MQTT_CLIENT_RECONNECT_MIN_MS
+#define CONFIG_NET_MQTT_CLIENT_RECONNECT_MIN_MS 1000
+#endif
+#ifndef CONFIG_NET_MQTT_CLIENT_RECONNECT_MAX_MS
+#define CONFIG_NET_MQTT_CLIENT_RECONNECT_MAX_MS 60000
+#endif
+
+void MqttReconnect::seed(const char *client_id, uint64_t now_ms) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_rng.seed(std::hash<std::string_view>()(client_id) ^ now_ms);
+}
+
+unsigned MqttReconnect::next_delay_ms(uint64_t now_ms) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_connected) {
+    m_connected = false;
+    m_down_since_ms = now_ms;
+    m_attempt = 0;
+  }
+
+  unsigned limit = m_first_ms;
+  if (m_attempt > 0) {
+    const unsigned shift = m_attempt - 1 < 16 ? m_attempt - 1 : 16;
+    const uint64_t backoff = uint64_t(m_min_ms) << shift;
+    limit = backoff < m_max_ms ? backoff : m_max_ms;
+  }
+  ++m_attempt;
+  ++m_attempts;
+  return std::uniform_int_distribution<unsigned>(0, limit)(m_rng);
+}
+
+void MqttReconnect::connected(uint64_t now_ms) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_down_since_ms) {
+    const uint32_t ms = now_ms - m_down_since_ms;
+    ++m_reconnects;
+    m_last_ms = ms;
+    m_total_ms += ms;
+    if (ms > m_max_ms_seen)
+      m_max_ms_seen = ms;
+  }
+  m_down_since_ms = 0;
+  m_attempt = 0;
+  m_connected = true;
+}
+
+void MqttReconnect::reset() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_attempt = 0;
+}
+
+void MqttReconnect::get_stats(struct mqtt_reconnect_stats *stats) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  *stats = mqtt_reconnect_stats { m_reconnects, m_attempts, m_last_ms, m_max_ms_seen, m_reconnects ? uint32_t(m_total_ms / m_reconnects) : 0 };
+}
+
+MqttReconnect& mqtt_reconnect() {
+  static MqttReconnect reconnect(CONFIG_NET_MQTT_CLIENT_RECONNECT_FIRST_MS, CONFIG_NET_MQTT_CLIENT_RECONNECT_MIN_MS,
+      CONFIG_NET_MQTT_CLIENT_RECONNECT_MAX_MS);
+  return reconnect;
+}
+
+bool io_mqtt_get_reconnect_stats(struct mqtt_reconnect_stats *stats) {
+  mqtt_reconnect().get_stats(stats);
+  return true;
+}
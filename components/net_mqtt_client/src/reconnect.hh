@@ -0,0 +1,57 @@
+/**
+ * \file   reconnect.hh
+ * \brief  Reconnect scheduling with exponential backoff and full jitter
+ */
+#pragma once
+
+#include "net_mqtt_client/mqtt.hh"
+
+#include <stdint.h>
+#include <mutex>
+#include <random>
+
+/**
+ * \brief  Compute delays between connection attempts and measure how long reconnecting took
+ *
+ *         The first retry after losing a connection is fast (random delay up to first_ms). Then the delay is
+ *         random between 0 and min(max_ms, min_ms * 2^n) ("full jitter"), so many clients losing the same broker
+ *         do not reconnect in lockstep.
+ */
+class MqttReconnect {
+public:
+  MqttReconnect(unsigned first_ms, unsigned min_ms, unsigned max_ms) :
+      m_first_ms(first_ms), m_min_ms(min_ms), m_max_ms(max_ms) {
+  }
+
+  /// \brief make the random delays differ between clients
+  void seed(const char *client_id, uint64_t now_ms);
+
+  /**
+   * \brief         connection was lost or a connection attempt failed
+   * \param now_ms  monotonic time in ms
+   * \return        delay in ms until next connection attempt
+   */
+  unsigned next_delay_ms(uint64_t now_ms);
+
+  /// \brief connection established (CONNACK received)
+  void connected(uint64_t now_ms);
+
+  /// \brief next attempt is a first retry again (e.g. after reconfiguring)
+  void reset();
+
+  /// \brief copy statistics
+  void get_stats(struct mqtt_reconnect_stats *stats);
+
+private:
+  std::mutex m_mutex;
+  std::minstd_rand m_rng;
+  unsigned m_first_ms, m_min_ms, m_max_ms;
+  unsigned m_attempt = 0;          ///< failed attempts since connection was lost
+  uint64_t m_down_since_ms = 0;    ///< time the connection was lost (0 if connected or never connected)
+  bool m_connected = false;
+  uint32_t m_reconnects = 0, m_attempts = 0, m_last_ms = 0, m_max_ms_seen = 0;
+  uint64_t m_total_ms = 0;
+};
+
+/// \brief the reconnect scheduler used by the client
+MqttReconnect& mqtt_reconnect();
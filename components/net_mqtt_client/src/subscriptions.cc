@@ -0,0 +1,89 @@
+#include "subscriptions.hh"
+
+bool MqttSubscriptions::add(const char *topic, int qos, bool connected) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_desired[topic] = qos;
+  if (!connected)
+    return false;
+  if (auto it = m_session.find(topic); it != m_session.end() && it->second == qos)
+    return false; // already subscribed (e.g. by replay before Net_Mqtt::connected was called)
+  for (auto &[id, topics] : m_pending) {
+    for (auto &t : topics) {
+      if (t.topic == topic && t.qos == qos)
+        return false; // waiting for SUBACK
+    }
+  }
+  return true;
+}
+
+void MqttSubscriptions::sent(int msg_id, const std::vector<topic_qos> &topics) {
+  if (msg_id < 0)
+    return;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (auto it = m_early_acks.find(msg_id); it != m_early_acks.end()) {
+    // SUBACK was processed by the client task before the caller returned from subscribe
+    grant(topics, it->second.empty() ? nullptr : it->second.data(), it->second.size());
+    m_early_acks.erase(it);
+    return;
+  }
+  auto &pending = m_pending[msg_id];
+  pending.insert(pending.end(), topics.begin(), topics.end());
+}
+
+void MqttSubscriptions::acked(int msg_id, const char *codes, size_t codes_len) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_pending.find(msg_id);
+  if (it == m_pending.end()) {
+    m_early_acks[msg_id] = codes ? std::string(codes, codes_len) : std::string();
+    return;
+  }
+  grant(it->second, codes, codes_len);
+  m_pending.erase(it);
+}
+
+void MqttSubscriptions::grant(const std::vector<topic_qos> &topics, const char *codes, size_t codes_len) {
+  for (size_t i = 0; i < topics.size(); ++i) {
+    auto &t = topics[i];
+    if (codes && i < codes_len && uint8_t(codes[i]) >= 0x80)
+      continue; // refused by broker
+    if (m_desired.count(t.topic)) // not unsubscribed meanwhile
+      m_session[t.topic] = t.qos;
+  }
+}
+
+bool MqttSubscriptions::remove(const char *topic, bool connected) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_desired.erase(topic);
+  bool pending = false;
+  for (auto &[id, topics] : m_pending) {
+    for (auto &t : topics)
+      pending = pending || t.topic == topic;
+  }
+  return connected && (m_session.erase(topic) > 0 || pending);
+}
+
+void MqttSubscriptions::connected(bool session_present, std::vector<topic_qos> &subscribe, std::vector<std::string> &unsubscribe) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!session_present)
+    m_session.clear();
+  m_pending.clear(); // packet IDs of the previous connection
+  m_early_acks.clear();
+
+  for (auto &[topic, qos] : m_desired) {
+    if (auto it = m_session.find(topic); it == m_session.end() || it->second != qos)
+      subscribe.push_back(topic_qos { topic, qos });
+  }
+  for (auto it = m_session.begin(); it != m_session.end();) {
+    if (m_desired.count(it->first)) {
+      ++it;
+      continue;
+    }
+    unsubscribe.push_back(it->first);
+    it = m_session.erase(it);
+  }
+}
+
+MqttSubscriptions& mqtt_subscriptions() {
+  static MqttSubscriptions subscriptions;
+  return subscriptions;
+}
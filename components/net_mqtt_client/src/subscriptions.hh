@@ -0,0 +1,77 @@
+/**
+ * \file   subscriptions.hh
+ * \brief  Desired MQTT subscriptions, restored after reconnecting
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * \brief  Track the subscriptions requested by the application and the subscriptions the broker has
+ *
+ *         After (re)connecting, only the difference is sent: everything if the broker started a new session,
+ *         or nothing if it kept our session and nothing changed while offline.  A topic counts as subscribed only
+ *         after its SUBACK granted it.  Topics without SUBACK are sent again after the next connect.
+ */
+class MqttSubscriptions {
+public:
+  struct topic_qos {
+    std::string topic;
+    uint8_t qos;
+  };
+
+  /**
+   * \brief            add TOPIC to desired subscriptions
+   * \param connected  client is connected
+   * \return           true if a SUBSCRIBE has to be sent now
+   */
+  bool add(const char *topic, int qos, bool connected);
+
+  /**
+   * \brief         a SUBSCRIBE packet was sent or queued
+   * \param msg_id  packet ID or -1 if sending failed (the topics are then sent again after the next connect)
+   * \param topics  topics of the packet, in order
+   */
+  void sent(int msg_id, const std::vector<topic_qos> &topics);
+
+  /**
+   * \brief            SUBACK received
+   * \param msg_id     packet ID
+   * \param codes      return codes (one per topic, >= 0x80 for failure) or NULL if unknown
+   * \param codes_len  length of CODES
+   */
+  void acked(int msg_id, const char *codes, size_t codes_len);
+
+  /**
+   * \brief            remove TOPIC from desired subscriptions
+   * \param connected  client is connected
+   * \return           true if an UNSUBSCRIBE has to be sent now
+   */
+  bool remove(const char *topic, bool connected);
+
+  /**
+   * \brief                  get changes to send after connecting
+   * \param session_present  broker has kept our previous session
+   * \param[out] subscribe   topics to subscribe
+   * \param[out] unsubscribe topics to unsubscribe
+   */
+  void connected(bool session_present, std::vector<topic_qos> &subscribe, std::vector<std::string> &unsubscribe);
+
+private:
+  void grant(const std::vector<topic_qos> &topics, const char *codes, size_t codes_len);
+
+private:
+  std::mutex m_mutex;
+  std::map<std::string, uint8_t> m_desired; ///< subscriptions requested by application
+  std::map<std::string, uint8_t> m_session; ///< subscriptions granted by the broker in the current session
+  std::map<int, std::vector<topic_qos>> m_pending; ///< SUBSCRIBE packets waiting for their SUBACK
+  std::map<int, std::string> m_early_acks; ///< return codes of SUBACKs received before \ref sent was called
+};
+
+/// \brief the subscriptions used by Net_Mqtt::subscribe
+MqttSubscriptions& mqtt_subscriptions();
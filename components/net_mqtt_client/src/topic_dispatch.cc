@@ -0,0 +1,55 @@
+#include "topic_dispatch.hh"
+#include "net_mqtt_client/mqtt.hh"
+#include "net_mqtt_client/topic_trie.hh"
+
+#include <string.h>
+#include <mutex>
+
+struct topic_handler_entry {
+  Net_Mqtt::topic_handler handler;
+  void *arg;
+};
+
+static std::mutex handlers_mutex; ///< protects handlers and root_topic. Held while calling the handlers
+static TopicTrie<topic_handler_entry> handlers;
+static char root_topic[sizeof cfg_mqtt::root_topic];
+static int root_topic_len;
+
+bool Net_Mqtt::add_topic_handler(const char *filter, topic_handler handler, void *arg) {
+  std::lock_guard<std::mutex> lock(handlers_mutex);
+  return handler && handlers.add(filter, topic_handler_entry { handler, arg });
+}
+
+void Net_Mqtt::clear_topic_handlers() {
+  std::lock_guard<std::mutex> lock(handlers_mutex);
+  handlers.clear();
+}
+
+void mqtt_topic_dispatch_setup(const char *root) {
+  std::lock_guard<std::mutex> lock(handlers_mutex);
+  strncpy(root_topic, root, sizeof root_topic - 1);
+  root_topic_len = strlen(root_topic);
+}
+
+const char *mqtt_root_topic() {
+  return root_topic;
+}
+
+int mqtt_topic_dispatch(const char *topic, int topic_len, const char *data, int data_len) {
+  std::lock_guard<std::mutex> lock(handlers_mutex);
+  if (handlers.empty())
+    return 0;
+
+  const char *rel = topic;
+  int rel_len = topic_len;
+  if (root_topic_len) {
+    if (topic_len <= root_topic_len || topic[root_topic_len] != '/' || strncmp(topic, root_topic, root_topic_len) != 0)
+      return 0;
+    rel += root_topic_len + 1;
+    rel_len -= root_topic_len + 1;
+  }
+
+  return handlers.for_each_match(rel, rel_len, [&](const topic_handler_entry &e) {
+    e.handler(topic, topic_len, data, data_len, e.arg);
+  });
+}
@@ -0,0 +1,14 @@
+/**
+ * \file   topic_dispatch.hh
+ * \brief  Deliver received messages to handlers registered by Net_Mqtt::add_topic_handler
+ */
+#pragma once
+
+/// \brief set root topic the registered topic filters are relative to
+void mqtt_topic_dispatch_setup(const char *root_topic);
+
+/// \brief get root topic set by \ref mqtt_topic_dispatch_setup
+const char *mqtt_root_topic();
+
+/// \brief call all handlers matching TOPIC. \return number of handlers called
+int mqtt_topic_dispatch(const char *topic, int topic_len, const char *data, int data_len);
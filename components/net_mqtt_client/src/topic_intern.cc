@@ -0,0 +1,39 @@
+#include "topic_intern.hh"
+#include "topic_dispatch.hh"
+#include "net_mqtt_client/mqtt.hh"
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+static std::mutex intern_mutex;
+static std::deque<std::string> topics; ///< never shrinks, so returned pointers stay valid
+static std::unordered_map<std::string_view, unsigned> by_name;
+static std::unordered_map<const char*, unsigned> by_ptr;
+
+const char* Net_Mqtt::intern_topic(const char *rel_topic) {
+  std::string topic = mqtt_root_topic();
+  if (!topic.empty())
+    topic += '/';
+  topic += rel_topic;
+
+  std::lock_guard<std::mutex> lock(intern_mutex);
+  if (auto it = by_name.find(topic); it != by_name.end())
+    return topics[it->second - 1].c_str();
+
+  topics.push_back(std::move(topic));
+  const unsigned alias = topics.size();
+  const std::string &s = topics.back();
+  by_name.emplace(s, alias);
+  by_ptr.emplace(s.c_str(), alias);
+  return s.c_str();
+}
+
+unsigned mqtt_topic_alias(const char *topic) {
+  std::lock_guard<std::mutex> lock(intern_mutex);
+  if (auto it = by_ptr.find(topic); it != by_ptr.end())
+    return it->second;
+  return 0;
+}
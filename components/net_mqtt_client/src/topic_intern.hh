@@ -0,0 +1,12 @@
+/**
+ * \file   topic_intern.hh
+ * \brief  Root topic prefixed topic strings held once, numbered for use as MQTT 5 topic aliases
+ */
+#pragma once
+
+/**
+ * \brief        Get alias number of an interned topic
+ * \param topic  topic string. Must be a pointer returned by Net_Mqtt::intern_topic() to get an alias
+ * \return       alias number (1 for the first interned topic, ...) or 0 if TOPIC is not interned
+ */
+unsigned mqtt_topic_alias(const char *topic);
@@ -0,0 +1,246 @@
+#include "net_mqtt_client/mqtt.hh"
+#include "topic_dispatch.hh"
+
+#include <uout/uo_callbacks.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+
+#ifndef CONFIG_NET_MQTT_CLIENT_UOUT_BRIDGE_KEYS
+#define CONFIG_NET_MQTT_CLIENT_UOUT_BRIDGE_KEYS 64
+#endif
+
+#define PATH_SIZE 96  ///< maximal length of a relative topic built from JSON keys
+#define MAX_DEPTH 8   ///< maximal nesting of JSON objects
+
+static constexpr uint32_t FNV_OFFSET = 2166136261u, FNV_PRIME = 16777619u;
+
+static uint32_t fnv1a(const char *s, size_t len, uint32_t h = FNV_OFFSET) {
+  for (size_t i = 0; i < len; ++i)
+    h = (h ^ uint8_t(s[i])) * FNV_PRIME;
+  return h;
+}
+
+/// \brief hash of the last published value per topic (open addressing, KEY == 0 means unused)
+static struct {
+  uint32_t key;
+  uint32_t value;
+  const char *topic; ///< interned topic of KEY
+} last_values[CONFIG_NET_MQTT_CLIENT_UOUT_BRIDGE_KEYS];
+static char last_values_root[sizeof cfg_mqtt::root_topic]; ///< root topic the slots were filled for
+static std::mutex bridge_mutex;
+static mqtt_bridge_stats stats;
+
+/// \brief test if TOPIC is "<ROOT>/<PATH>"
+static bool topic_equals(const char *topic, const char *root, const char *path) {
+  const size_t root_len = strlen(root);
+  if (strncmp(topic, root, root_len) != 0)
+    return false;
+  topic += root_len;
+  if (root_len && *topic++ != '/')
+    return false;
+  return strcmp(topic, path) == 0;
+}
+
+/**
+ * \brief        Remember the value hash of a key
+ *
+ *               Only keys which get a slot in the table have their topic interned, so the number of interned
+ *               topics (and topic aliases used) is bounded by the table size.  A slot is used only if its topic
+ *               equals ROOT/PATH, so keys with the same hash don't share it.  A new root topic frees all slots.
+ *
+ * \param path   relative topic of KEY
+ * \param topic  set to the interned topic of KEY, or nullptr if the table is full
+ * \return       false if the key already had the same value hash
+ */
+static bool value_changed(uint32_t key, uint32_t value, const char *root, const char *path, const char *&topic) {
+  std::lock_guard<std::mutex> lock(bridge_mutex);
+  if (strcmp(root, last_values_root) != 0) {
+    memset(last_values, 0, sizeof last_values);
+    snprintf(last_values_root, sizeof last_values_root, "%s", root);
+  }
+
+  for (unsigned i = 0, idx = key % CONFIG_NET_MQTT_CLIENT_UOUT_BRIDGE_KEYS; i < CONFIG_NET_MQTT_CLIENT_UOUT_BRIDGE_KEYS;
+      ++i, idx = (idx + 1) % CONFIG_NET_MQTT_CLIENT_UOUT_BRIDGE_KEYS) {
+    auto &e = last_values[idx];
+    if (e.key == 0) {
+      e = { key, value, Net_Mqtt::intern_topic(path) };
+      topic = e.topic;
+      ++stats.published;
+      return true;
+    }
+    if (e.key != key || !topic_equals(e.topic, root, path))
+      continue; // other key, or hash collision
+    topic = e.topic;
+    if (e.value == value) {
+      ++stats.suppressed;
+      return false;
+    }
+    e.value = value;
+    ++stats.published;
+    return true;
+  }
+  topic = nullptr;
+  ++stats.published; // table full: publish without suppression
+  return true;
+}
+
+/// \brief forget value hash VALUE of interned TOPIC (nullptr if it has no slot), so the value is published again by the next event
+static void value_failed(const char *topic, uint32_t value) {
+  std::lock_guard<std::mutex> lock(bridge_mutex);
+  --stats.published;
+  ++stats.dropped;
+  for (auto &e : last_values)
+    if (topic && e.topic == topic && e.value == value)
+      e.value = ~value;
+}
+
+/// \brief publish VALUE to topic "<root_topic>/<PATH>" unless it was already published
+static void bridge_value(const char *path, size_t path_len, const char *value, size_t value_len) {
+  const char *root = mqtt_root_topic();
+  uint32_t key = fnv1a(path, path_len);
+  if (!key)
+    key = 1;
+  const uint32_t value_hash = fnv1a(value, value_len);
+  const char *topic;
+  if (!value_changed(key, value_hash, root, path, topic))
+    return;
+
+  char topic_buf[sizeof cfg_mqtt::root_topic + PATH_SIZE + 1];
+  const char *interned = topic;
+  if (!topic) {
+    snprintf(topic_buf, sizeof topic_buf, "%s%s%s", root, *root ? "/" : "", path);
+    topic = topic_buf;
+  }
+  if (Net_Mqtt::get_this().publish_data(topic, value, value_len, 0, true) < 0)
+    value_failed(interned, value_hash);
+}
+
+static const char* skip_ws(const char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    ++p;
+  return p;
+}
+
+/// \brief skip string starting after the opening quote. \return pointer to closing quote or nullptr
+static const char* string_end(const char *p) {
+  for (; *p && *p != '"'; ++p)
+    if (*p == '\\' && p[1])
+      ++p;
+  return *p ? p : nullptr;
+}
+
+/// \brief skip array starting at '['. \return pointer after closing bracket or nullptr
+static const char* array_end(const char *p) {
+  for (int depth = 0; *p; ++p) {
+    if (*p == '"') {
+      if (!(p = string_end(p + 1)))
+        return nullptr;
+    } else if (*p == '[' || *p == '{') {
+      ++depth;
+    } else if ((*p == ']' || *p == '}') && --depth == 0) {
+      return p + 1;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * \brief           Publish each leaf of a JSON value. Object keys are joined by '/' to form the relative topic
+ * \param p         start of JSON value
+ * \param path      buffer holding the relative topic of this value
+ * \param path_len  length of PATH used by this value (too long paths are parsed but not published)
+ * \return          pointer after the value or nullptr on syntax error
+ */
+static const char* flatten(const char *p, char *path, size_t path_len, int depth) {
+  p = skip_ws(p);
+  const bool publishable = path_len > 0 && path_len < PATH_SIZE;
+
+  if (*p == '{') {
+    if (depth >= MAX_DEPTH)
+      return nullptr;
+    for (p = skip_ws(p + 1); *p != '}'; p = skip_ws(p + 1)) {
+      if (*p != '"')
+        return nullptr;
+      const char *key = p + 1, *key_end = string_end(key);
+      if (!key_end)
+        return nullptr;
+      p = skip_ws(key_end + 1);
+      if (*p != ':')
+        return nullptr;
+
+      size_t len = path_len;
+      if (len && len < PATH_SIZE)
+        path[len++] = '/';
+      if (len + (key_end - key) < PATH_SIZE) {
+        memcpy(path + len, key, key_end - key);
+        path[len += key_end - key] = '\0';
+      } else {
+        len = PATH_SIZE;
+      }
+
+      if (!(p = flatten(p + 1, path, len, depth + 1)))
+        return nullptr;
+      p = skip_ws(p);
+      if (*p == '}')
+        break;
+      if (*p != ',')
+        return nullptr;
+    }
+    return p + 1;
+  }
+
+  const char *value = p, *end;
+  if (*p == '"') {
+    if (!(end = string_end(++value)))
+      return nullptr;
+    p = end + 1;
+  } else if (*p == '[') {
+    if (!(p = end = array_end(p)))
+      return nullptr;
+  } else {
+    while (*p && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\r' && *p != '\n')
+      ++p;
+    if (p == value)
+      return nullptr;
+    end = p;
+  }
+
+  if (publishable) {
+    path[path_len] = '\0';
+    bridge_value(path, path_len, value, end - value);
+  }
+  return p;
+}
+
+static void bridge_cb(const uoCb_msgT msg) {
+  const char *json = uoCb_jsonFromMsg(msg);
+  if (!json)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(bridge_mutex);
+    ++stats.events;
+  }
+  char path[PATH_SIZE + 1];
+  if (*skip_ws(json) == '{')
+    flatten(json, path, 0, 0);
+}
+
+void io_mqtt_uout_bridge_setup(const struct uo_flagsT *flags) {
+  uoCb_unsubscribe(bridge_cb);
+  if (!flags)
+    return;
+
+  uo_flagsT f = *flags;
+  f.fmt.json = true;
+  f.fmt.txt = false;
+  uoCb_subscribe(bridge_cb, f);
+}
+
+bool io_mqtt_get_bridge_stats(struct mqtt_bridge_stats *dst) {
+  std::lock_guard<std::mutex> lock(bridge_mutex);
+  *dst = stats;
+  return true;
+}
@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+"""Minimal MQTT 3.1.1 / 5 broker stand-in for running and measuring the host client.
+
+Supports what net_mqtt_client uses: CONNECT (no authentication), PUBLISH with QoS 0-2, retained messages,
+(UN)SUBSCRIBE with '+' and '#' wildcards, PINGREQ, DISCONNECT and MQTT 5 topic aliases (client to broker).
+Sessions are not persisted (CONNACK session present is always 0).
+
+Combined with CONFIG_NET_MQTT_CLIENT_PERF_STATS the client reports throughput and publish to acknowledge
+latency (io_mqtt_get_perf_stats) without depending on an external broker.
+bench/mqtt_bench starts this script itself (host build with -DNET_MQTT_CLIENT_BENCH=ON).
+
+Usage: mqtt_broker_stub.py [--port 1883] [--topic-alias-max 16] [--verbose]
+"""
+
+import argparse
+import selectors
+import socket
+import struct
+import sys
+import time
+
+PT_CONNECT, PT_CONNACK, PT_PUBLISH, PT_PUBACK = 0x10, 0x20, 0x30, 0x40
+PT_PUBREC, PT_PUBREL, PT_PUBCOMP = 0x50, 0x60, 0x70
+PT_SUBSCRIBE, PT_SUBACK, PT_UNSUBSCRIBE, PT_UNSUBACK = 0x80, 0x90, 0xA0, 0xB0
+PT_PINGREQ, PT_PINGRESP, PT_DISCONNECT = 0xC0, 0xD0, 0xE0
+
+PROP_TOPIC_ALIAS_MAXIMUM = 0x22
+PROP_TOPIC_ALIAS = 0x23
+
+
+class Disconnect(Exception):
+    pass
+
+
+def varint(n):
+    out = bytearray()
+    while True:
+        b = n & 0x7f
+        n >>= 7
+        out.append(b | (0x80 if n else 0))
+        if not n:
+            return bytes(out)
+
+
+def read_varint(buf, i):
+    value, shift = 0, 0
+    while True:
+        c = buf[i]
+        value |= (c & 0x7f) << shift
+        i += 1
+        shift += 7
+        if not c & 0x80:
+            return value, i
+
+
+def packet(type_flags, body):
+    return bytes([type_flags]) + varint(len(body)) + body
+
+
+def utf8(s):
+    b = s.encode()
+    return struct.pack('>H', len(b)) + b
+
+
+def topic_matches(topic_filter, topic):
+    fl, tl = topic_filter.split('/'), topic.split('/')
+    for i, level in enumerate(fl):
+        if level == '#':
+            return True
+        if i >= len(tl) or (level != '+' and level != tl[i]):
+            return False
+    return len(fl) == len(tl)
+
+
+class Client:
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf = b''
+        self.v5 = False
+        self.subs = set()
+        self.aliases = {}
+        self.rx_msgs = 0
+        self.rx_bytes = 0
+        self.since = time.monotonic()
+
+    def send(self, data):
+        try:
+            self.sock.sendall(data)
+        except OSError:
+            pass
+
+    def publish(self, topic, payload, retain=False):
+        body = utf8(topic) + (b'\x00' if self.v5 else b'')
+        self.send(packet(PT_PUBLISH | (1 if retain else 0), body + payload))
+
+
+class Broker:
+    def __init__(self, args):
+        self.args = args
+        self.sel = selectors.DefaultSelector()
+        self.clients = {}
+        self.retained = {}
+
+    def log(self, *msg):
+        if self.args.verbose:
+            print(*msg, file=sys.stderr, flush=True)
+
+    def deliver(self, topic, payload):
+        for c in self.clients.values():
+            if any(topic_matches(f, topic) for f in c.subs):
+                c.publish(topic, payload)
+
+    def handle_connect(self, c, body):
+        c.v5 = body[6] == 5
+        props = b''
+        if c.v5:
+            alias_max = struct.pack('>BH', PROP_TOPIC_ALIAS_MAXIMUM, self.args.topic_alias_max)
+            props = varint(len(alias_max)) + alias_max
+        c.send(packet(PT_CONNACK, b'\x00\x00' + props))
+        self.log('connect', 'v5' if c.v5 else 'v3.1.1')
+
+    def handle_publish(self, c, hdr, body):
+        qos = (hdr >> 1) & 3
+        topic_len = struct.unpack('>H', body[:2])[0]
+        topic = body[2:2 + topic_len].decode()
+        i = 2 + topic_len
+        pid = b''
+        if qos:
+            pid = body[i:i + 2]
+            i += 2
+        if c.v5:
+            props_len, j = read_varint(body, i)
+            props = body[j:j + props_len]
+            i = j + props_len
+            k = 0
+            while k < len(props) and props[k] == PROP_TOPIC_ALIAS:
+                alias = struct.unpack('>H', props[k + 1:k + 3])[0]
+                if topic:
+                    c.aliases[alias] = topic
+                else:
+                    topic = c.aliases[alias]
+                k += 3
+        payload = body[i:]
+        c.rx_msgs += 1
+        c.rx_bytes += len(body)
+        if hdr & 1:
+            self.retained[topic] = payload
+        if qos == 1:
+            c.send(packet(PT_PUBACK, pid))
+        elif qos == 2:
+            c.send(packet(PT_PUBREC, pid))
+        self.deliver(topic, payload)
+
+    def handle_subscribe(self, c, body):
+        pid, i = body[:2], 2
+        if c.v5:
+            props_len, i = read_varint(body, i)
+            i += props_len
+        codes = b''
+        while i < len(body):
+            n = struct.unpack('>H', body[i:i + 2])[0]
+            topic_filter = body[i + 2:i + 2 + n].decode()
+            i += 2 + n
+            codes += bytes([body[i] & 3])
+            i += 1
+            c.subs.add(topic_filter)
+        c.send(packet(PT_SUBACK, pid + (b'\x00' if c.v5 else b'') + codes))
+        self.log('subscribe', len(codes), 'topics')
+        for topic, payload in self.retained.items():
+            if any(topic_matches(f, topic) for f in c.subs):
+                c.publish(topic, payload, retain=True)
+
+    def handle_unsubscribe(self, c, body):
+        pid, i = body[:2], 2
+        if c.v5:
+            props_len, i = read_varint(body, i)
+            i += props_len
+        while i < len(body):
+            n = struct.unpack('>H', body[i:i + 2])[0]
+            c.subs.discard(body[i + 2:i + 2 + n].decode())
+            i += 2 + n
+        c.send(packet(PT_UNSUBACK, pid + (b'\x00' if c.v5 else b'')))
+
+    def handle(self, c, hdr, body):
+        t = hdr & 0xf0
+        if t == PT_CONNECT:
+            self.handle_connect(c, body)
+        elif t == PT_PUBLISH:
+            self.handle_publish(c, hdr, body)
+        elif t == PT_PUBREL:
+            c.send(packet(PT_PUBCOMP, body[:2]))
+        elif t == PT_SUBSCRIBE:
+            self.handle_subscribe(c, body)
+        elif t == PT_UNSUBSCRIBE:
+            self.handle_unsubscribe(c, body)
+        elif t == PT_PINGREQ:
+            c.send(packet(PT_PINGRESP, b''))
+        elif t == PT_DISCONNECT:
+            raise Disconnect()
+
+    def close(self, c):
+        secs = time.monotonic() - c.since
+        self.log('disconnect: received %d messages, %d bytes in %.1f s' % (c.rx_msgs, c.rx_bytes, secs))
+        self.sel.unregister(c.sock)
+        del self.clients[c.sock]
+        c.sock.close()
+
+    def on_read(self, sock):
+        c = self.clients[sock]
+        try:
+            data = sock.recv(65536)
+        except OSError:
+            data = b''
+        if not data:
+            self.close(c)
+            return
+        buf = c.buf + data
+        while len(buf) >= 2:
+            try:
+                n, i = read_varint(buf, 1)
+            except IndexError:
+                break
+            if len(buf) < i + n:
+                break
+            try:
+                self.handle(c, buf[0], buf[i:i + n])
+            except Disconnect:
+                self.close(c)
+                return
+            buf = buf[i + n:]
+        c.buf = buf
+
+    def on_accept(self, listen_sock):
+        sock, _ = listen_sock.accept()
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.clients[sock] = Client(sock)
+        self.sel.register(sock, selectors.EVENT_READ, self.on_read)
+
+    def run(self):
+        ls = socket.socket()
+        ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        ls.bind((self.args.bind, self.args.port))
+        ls.listen()
+        self.sel.register(ls, selectors.EVENT_READ, self.on_accept)
+        self.log('listening on %s:%d' % (self.args.bind, self.args.port))
+        while True:
+            for key, _ in self.sel.select():
+                key.data(key.fileobj)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    ap.add_argument('--bind', default='127.0.0.1')
+    ap.add_argument('--port', type=int, default=1883)
+    ap.add_argument('--topic-alias-max', type=int, default=16, help='topic alias maximum sent in MQTT 5 CONNACK')
+    ap.add_argument('--verbose', '-v', action='store_true')
+    args = ap.parse_args()
+    try:
+        Broker(args).run()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()